@@ -0,0 +1,174 @@
+// SoapyBuffer.hpp - stream buffer memory
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyBuffer_hpp
+#define SoapyBuffer_hpp
+
+// Stream buffers are read & written by real-time pumps, which should never take a page
+// fault. So they are mapped rather than malloc'd: on huge pages if asked (reserved ones
+// if any, else advising transparent ones), locked in memory if asked, bound to a NUMA node
+// if given, and prefaulted before use. Whatever cannot be done is logged (at the level
+// given) and the buffer works regardless.
+// NB: Linux only (MAP_HUGETLB, mbind).
+
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <SoapySDR/Logger.hpp>
+
+#define TCPREMOTE_BUFFER_HUGE   1
+#define TCPREMOTE_BUFFER_LOCK   2
+#define TCPREMOTE_BUFFER_NUMA   4
+
+// "none" or any of "huge,lock,numa" (or space separated, as commas separate stream arguments)
+static inline bool parseBufferFlags(const std::string &spec, int &flags) {
+    flags = 0;
+    if ("none"==spec)
+        return true;
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = spec.find_first_of(", ", cur);
+        std::string item = spec.substr(cur, nxt-cur);
+        if ("huge"==item)
+            flags |= TCPREMOTE_BUFFER_HUGE;
+        else if ("lock"==item)
+            flags |= TCPREMOTE_BUFFER_LOCK;
+        else if ("numa"==item)
+            flags |= TCPREMOTE_BUFFER_NUMA;
+        else
+            return false;
+    } while (nxt!=std::string::npos);
+    return true;
+}
+
+// NUMA node of a CPU (-1 unknown, eg: not a NUMA system)
+static inline int cpuNode(int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu"+std::to_string(cpu);
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return -1;
+    int node = -1;
+    struct dirent *ent;
+    while (node<0 && (ent = readdir(dir))!=nullptr) {
+        if (0==strncmp(ent->d_name, "node", 4) && ent->d_name[4]>='0' && ent->d_name[4]<='9')
+            node = atoi(ent->d_name+4);
+    }
+    closedir(dir);
+    return node;
+}
+
+class SoapyBuffer
+{
+public:
+    SoapyBuffer(): mem(nullptr), len(0), want(0), flags(0), node(-1), level(SOAPY_SDR_DEBUG) {}
+    ~SoapyBuffer() { release(); }
+
+    // set how buffers are allocated: TCPREMOTE_BUFFER_* flags, node (-1 any, only with _NUMA),
+    // what for & level to report at
+    void setup(int flags, int node, const std::string &what, SoapySDRLogLevel level) {
+        this->flags = flags;
+        this->node = node;
+        this->what = what;
+        this->level = level;
+    }
+    // at least size bytes, prefaulted (contents are not kept when it grows), nullptr on failure
+    void *ensure(size_t size) {
+        if (mem && size<=want)
+            return mem;
+        release();
+        return alloc(size);
+    }
+    void release() {
+        if (mem) {
+            munmap(mem, len);
+            mem = nullptr;
+            len = want = 0;
+        }
+    }
+    void *data() const { return mem; }
+    size_t size() const { return want; }
+    // what we got, eg: "5242880 bytes, huge pages, locked, node 0"
+    const std::string &info() const { return got; }
+
+private:
+    void *mem;
+    size_t len, want;
+    int flags, node;
+    std::string what, got;
+    SoapySDRLogLevel level;
+
+    // no copies, we own the mapping
+    SoapyBuffer(const SoapyBuffer &);
+    SoapyBuffer &operator=(const SoapyBuffer &);
+
+    void *alloc(size_t size) {
+        got = std::to_string(size)+" bytes";
+        size_t page = sysconf(_SC_PAGESIZE);
+        len = (size+page-1)/page*page;
+        mem = MAP_FAILED;
+        if (flags & TCPREMOTE_BUFFER_HUGE) {
+            // reserved huge pages (default size), else ask for transparent ones
+            size_t huge = 2*1024*1024;
+            size_t hlen = (size+huge-1)/huge*huge;
+            mem = mmap(nullptr, hlen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+            if (mem!=MAP_FAILED) {
+                len = hlen;
+                got += ", huge pages";
+            }
+        }
+        if (MAP_FAILED==mem) {
+            mem = mmap(nullptr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if (MAP_FAILED==mem) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "%s: unable to map %zu bytes: %s", what.c_str(), size, strerror(errno));
+                mem = nullptr;
+                len = 0;
+                return nullptr;
+            }
+            if (flags & TCPREMOTE_BUFFER_HUGE) {
+                if (madvise(mem, len, MADV_HUGEPAGE)<0) {
+                    SoapySDR_logf(level, "%s: no huge pages reserved (see /proc/sys/vm/nr_hugepages) or transparent: %s",
+                        what.c_str(), strerror(errno));
+                } else {
+                    SoapySDR_logf(level, "%s: no huge pages reserved (see /proc/sys/vm/nr_hugepages), using transparent huge pages",
+                        what.c_str());
+                    got += ", transparent huge pages";
+                }
+            }
+        }
+        want = size;
+        // bind before the pages are touched, so they are placed there
+        if ((flags & TCPREMOTE_BUFFER_NUMA) && node>=0) {
+            unsigned long mask[16];
+            memset(mask, 0, sizeof(mask));
+            if ((size_t)node>=sizeof(mask)*8-1) {
+                SoapySDR_logf(level, "%s: NUMA node %d out of range, not bound", what.c_str(), node);
+            } else {
+                mask[node/(sizeof(long)*8)] = 1UL<<(node%(sizeof(long)*8));
+                // MPOL_BIND, MPOL_MF_MOVE (numaif.h, without needing libnuma)
+                if (syscall(SYS_mbind, mem, len, 2, mask, sizeof(mask)*8, 1<<1)<0)
+                    SoapySDR_logf(level, "%s: unable to bind to NUMA node %d: %s", what.c_str(), node, strerror(errno));
+                else
+                    got += ", node "+std::to_string(node);
+            }
+        }
+        // prefault (locking does too, but may fail)
+        memset(mem, 0, len);
+        if (flags & TCPREMOTE_BUFFER_LOCK) {
+            if (mlock(mem, len)<0)
+                SoapySDR_logf(level, "%s: unable to lock %zu bytes in memory (see RLIMIT_MEMLOCK): %s", what.c_str(), len, strerror(errno));
+            else
+                got += ", locked";
+        }
+        return mem;
+    }
+};
+
+#endif
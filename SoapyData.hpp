@@ -0,0 +1,182 @@
+// SoapyData.hpp - data stream framing and sample conversion
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyData_hpp
+#define SoapyData_hpp
+
+// Data streams are a sequence of blocks, each prefixed by a small
+// fixed header. The header tells the receiver how the payload is
+// encoded, so the sender may change wire format (or decimate) at
+// any block boundary without another round trip. Only streams sent
+// to a TCPREMOTE_DATA_SEND_BLOCKS connection are framed, others carry
+// bare samples in the stream format as they always have.
+// NB: as for sample data, header fields are in host byte order.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// block header magic, same as our default port
+#define TCPREMOTE_BLOCK_MAGIC 0x50AF
+
+struct TCPRemoteBlock
+{
+    uint16_t magic;     // TCPREMOTE_BLOCK_MAGIC, detects loss of sync
+    uint8_t  format;    // wire format code of payload (TCPREMOTE_FMT_<x>)
+    uint8_t  decim;     // decimation applied by sender (1=none)
+    uint32_t flags;     // SoapySDR stream flags for this block
+    uint32_t seq;       // block sequence number
+    uint32_t length;    // payload length in bytes (whole elements)
+    int64_t  timeNs;    // time of first sample, if flags has SOAPY_SDR_HAS_TIME
+};
+
+// block flag (clear of SoapySDR's own & user flags): the payload is a TCPRemoteDwell
+// marker, not samples. Sent by hop schedules ahead of each dwell's samples, the last
+// block of each dwell has SOAPY_SDR_END_BURST.
+#define TCPREMOTE_BLOCK_DWELL (1<<28)
+
+struct TCPRemoteDwell
+{
+    uint32_t index;     // position in the hop list, TCPREMOTE_DWELL_DONE after the last pass
+    uint32_t pass;      // times through the list so far
+    double frequency;   // tuned frequency (Hz)
+};
+
+#define TCPREMOTE_DWELL_DONE 0xFFFFFFFF
+
+// block flag: timeNs is the server's clock (CLOCK_REALTIME) when the first sample was read,
+// as the driver gave no time of its own. Clients may relate it to their own clock.
+#define TCPREMOTE_BLOCK_HOSTTIME (1<<27)
+
+// wire format codes
+enum
+{
+    TCPREMOTE_FMT_CS8,
+    TCPREMOTE_FMT_CS16,
+    TCPREMOTE_FMT_CF32,
+    TCPREMOTE_FMT_UNKNOWN
+};
+
+static inline int formatCode(const std::string &fmt)
+{
+    if ("CS8"==fmt) return TCPREMOTE_FMT_CS8;
+    if ("CS16"==fmt) return TCPREMOTE_FMT_CS16;
+    if ("CF32"==fmt) return TCPREMOTE_FMT_CF32;
+    return TCPREMOTE_FMT_UNKNOWN;
+}
+
+static inline const char *formatName(int code)
+{
+    switch (code) {
+    case TCPREMOTE_FMT_CS8: return "CS8";
+    case TCPREMOTE_FMT_CS16: return "CS16";
+    case TCPREMOTE_FMT_CF32: return "CF32";
+    }
+    return "?";
+}
+
+// size of one complex sample (I+Q) in bytes
+static inline size_t formatSize(int code)
+{
+    switch (code) {
+    case TCPREMOTE_FMT_CS8: return 2;
+    case TCPREMOTE_FMT_CS16: return 4;
+    case TCPREMOTE_FMT_CF32: return 8;
+    }
+    return 0;
+}
+
+// one step of the adaptive wire format ladder
+struct TCPRemoteLevel
+{
+    int format;
+    int decim;
+};
+
+// parse a space separated level list: "<fmt>[/<decim>] ..." eg: "CS8 CS8/2 CS8/4"
+static inline bool parseLevels(const std::string &spec, std::vector<TCPRemoteLevel> &levels)
+{
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = spec.find(' ', cur);
+        std::string lvl = spec.substr(cur, nxt-cur);
+        if (lvl.length()==0)
+            continue;
+        TCPRemoteLevel l;
+        l.decim = 1;
+        size_t sl = lvl.find('/');
+        if (sl!=std::string::npos) {
+            l.decim = atoi(lvl.substr(sl+1).c_str());
+            lvl = lvl.substr(0, sl);
+        }
+        l.format = formatCode(lvl);
+        if (TCPREMOTE_FMT_UNKNOWN==l.format || l.decim<1 || l.decim>255)
+            return false;
+        levels.push_back(l);
+    } while (nxt!=std::string::npos);
+    return true;
+}
+
+// nominal full scale of each format
+template <typename T> struct FormatScale;
+template <> struct FormatScale<int8_t> { static constexpr float value = 127.0f; };
+template <> struct FormatScale<int16_t> { static constexpr float value = 32767.0f; };
+template <> struct FormatScale<float> { static constexpr float value = 1.0f; };
+
+template <typename T> static inline T fromFloat(float v)
+{
+    // round & clamp to the integer range
+    v += v<0? -0.5f: 0.5f;
+    if (v > FormatScale<T>::value) return (T)FormatScale<T>::value;
+    if (v < -FormatScale<T>::value) return (T)-FormatScale<T>::value;
+    return (T)v;
+}
+template <> inline float fromFloat<float>(float v) { return v; }
+
+// convert (and optionally decimate by averaging) interleaved elements of
+// chans complex samples each, returns number of output elements.
+template <typename I, typename O>
+static size_t convertElements(O *dst, const I *src, size_t elems, size_t chans, size_t decim)
+{
+    const float gain = FormatScale<O>::value/(FormatScale<I>::value*decim);
+    const size_t width = chans*2;
+    size_t out = elems/decim;
+    for (size_t e=0; e<out; ++e) {
+        const I *s = src + e*decim*width;
+        O *d = dst + e*width;
+        for (size_t v=0; v<width; ++v) {
+            float acc = 0.0f;
+            for (size_t n=0; n<decim; ++n)
+                acc += (float)s[n*width+v];
+            d[v] = fromFloat<O>(acc*gain);
+        }
+    }
+    return out;
+}
+
+template <typename I>
+static size_t convertElementsFrom(void *dst, int dfmt, const I *src, size_t elems, size_t chans, size_t decim)
+{
+    switch (dfmt) {
+    case TCPREMOTE_FMT_CS8: return convertElements(( int8_t *)dst, src, elems, chans, decim);
+    case TCPREMOTE_FMT_CS16: return convertElements((int16_t *)dst, src, elems, chans, decim);
+    case TCPREMOTE_FMT_CF32: return convertElements((float *)dst, src, elems, chans, decim);
+    }
+    return 0;
+}
+
+// runtime dispatch of the above for wire format codes
+static inline size_t convertSamples(void *dst, int dfmt, const void *src, int sfmt, size_t elems, size_t chans, size_t decim = 1)
+{
+    switch (sfmt) {
+    case TCPREMOTE_FMT_CS8: return convertElementsFrom(dst, dfmt, (const int8_t *)src, elems, chans, decim);
+    case TCPREMOTE_FMT_CS16: return convertElementsFrom(dst, dfmt, (const int16_t *)src, elems, chans, decim);
+    case TCPREMOTE_FMT_CF32: return convertElementsFrom(dst, dfmt, (const float *)src, elems, chans, decim);
+    }
+    return 0;
+}
+
+#endif
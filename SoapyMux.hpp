@@ -0,0 +1,326 @@
+// SoapyMux.hpp - session multiplexer, many logical connections over one socket
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyMux_hpp
+#define SoapyMux_hpp
+
+// A session carries each logical connection (RPC, log, data..) as a channel,
+// framed on one shared socket. Locally each channel is one end of a socketpair,
+// so the rest of the code reads/writes the other end exactly as it would a
+// dedicated TCP connection. Receivers grant credit per channel and senders never
+// exceed it, so a slow reader on one channel cannot block the shared socket (and
+// with it everyone else's RPC replies). Data frames are kept small so channels
+// interleave fairly.
+// NB: as for data blocks, frame header fields are in host byte order.
+
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <cstring>
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <sys/socket.h>
+#include <SoapySDR/Logger.hpp>
+
+struct TCPRemoteMuxFrame
+{
+    uint16_t chan;      // logical channel
+    uint16_t type;      // TCPREMOTE_MUX_<x>
+    uint32_t len;       // payload bytes (DATA) or credit granted (CREDIT)
+};
+
+// frame types
+enum
+{
+    TCPREMOTE_MUX_OPEN,
+    TCPREMOTE_MUX_DATA,
+    TCPREMOTE_MUX_CREDIT,
+    TCPREMOTE_MUX_CLOSE
+};
+
+// largest data frame payload
+const size_t TCPREMOTE_MUX_CHUNK = 16384;
+// default per channel window (bytes in flight)
+const size_t TCPREMOTE_MUX_WINDOW = 1048576;
+
+class SoapyMux
+{
+public:
+    // accept (if set) is called from run() with the local socket of each channel the peer opens
+    SoapyMux(int socket, size_t win, std::function<void(int)> acc = nullptr):
+        sock(socket), window(win), accept(acc), nextChan(0), quit(false)
+    {
+        SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyMux::<cons>(%d,%d)", socket, (int)win);
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+        if (pipe(wake)<0)
+            wake[0] = wake[1] = -1;
+        fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    }
+    ~SoapyMux() {
+        SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyMux::<dest>(%d)", sock);
+        stop();
+        if (thread.joinable())
+            thread.join();
+        for (auto &it: chans)
+            close(it.second.fd);
+        for (auto &it: pending)
+            close(it.second);
+        close(wake[0]);
+        close(wake[1]);
+        close(sock);
+    }
+    // run the session in our own thread (joined on destruction)
+    void start() {
+        thread = std::thread(&SoapyMux::run, this);
+    }
+    void stop() {
+        quit = true;
+        if (write(wake[1], "q", 1)<0)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux::stop: %s", strerror(errno));
+    }
+    // the shared socket
+    int socket() const { return sock; }
+    // open a new channel to the peer, returns the local socket to use
+    int open() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux::open: socketpair: %s", strerror(errno));
+            return -1;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(std::make_pair(nextChan++, sv[0]));
+        }
+        if (write(wake[1], "o", 1)<0)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux::open: %s", strerror(errno));
+        return sv[1];
+    }
+    // session loop, returns when the shared socket closes or stop() is called
+    void run() {
+        SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyMux: session started");
+        std::vector<struct pollfd> pfds;
+        std::vector<uint16_t> ids;
+        while (!quit) {
+            pfds.clear();
+            ids.clear();
+            pfds.push_back({ wake[0], POLLIN, 0 });
+            pfds.push_back({ sock, (short)(POLLIN | (txBuf.empty()? 0: POLLOUT)), 0 });
+            for (auto &it: chans) {
+                Channel &ch = it.second;
+                short ev = 0;
+                // read locally only with credit, and while the shared socket is keeping up
+                if (ch.credit>0 && !ch.closing && txBuf.size()<TCPREMOTE_MUX_CHUNK*4)
+                    ev |= POLLIN;
+                if (!ch.inQ.empty())
+                    ev |= POLLOUT;
+                // nothing to do (NB: poll ignores -ve fds, which stops POLLHUP spinning)
+                pfds.push_back({ ev? ch.fd: -1, ev, 0 });
+                ids.push_back(it.first);
+            }
+            if (poll(pfds.data(), pfds.size(), -1)<0) {
+                if (EINTR==errno)
+                    continue;
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux: poll: %s", strerror(errno));
+                break;
+            }
+            if (pfds[0].revents)
+                openPending();
+            if (pfds[1].revents & POLLOUT)
+                sendTx();
+            if ((pfds[1].revents & (POLLIN|POLLERR|POLLHUP)) && !receive())
+                break;
+            for (size_t idx=2; idx<pfds.size(); ++idx) {
+                if (pfds[idx].revents)
+                    service(ids[idx-2], pfds[idx].revents);
+            }
+            sendTx();
+        }
+        for (auto &it: chans)
+            close(it.second.fd);
+        chans.clear();
+        SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyMux: session ended");
+    }
+
+private:
+    struct Channel
+    {
+        int fd;                 // our end of the socketpair
+        std::string inQ;        // received from peer, not yet written to fd
+        size_t credit;          // bytes we may send before the peer grants more
+        size_t granted;         // bytes the peer may send before we grant more
+        size_t consumed;        // bytes written to fd since our last grant
+        bool closing;           // peer closed, close fd once inQ is written
+    };
+    int sock;
+    size_t window;
+    std::function<void(int)> accept;
+    std::map<uint16_t, Channel> chans;
+    std::string txBuf, rxBuf;
+    // channels opened by other threads, not yet announced
+    std::mutex mutex;
+    std::vector<std::pair<uint16_t, int>> pending;
+    uint16_t nextChan;
+    int wake[2];
+    volatile bool quit;
+    std::thread thread;
+
+    void addChannel(uint16_t id, int fd) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        Channel &ch = chans[id];
+        ch.fd = fd;
+        ch.credit = window;
+        ch.granted = window;
+        ch.consumed = 0;
+        ch.closing = false;
+    }
+    void frame(uint16_t chan, uint16_t type, uint32_t len, const void *data = nullptr) {
+        TCPRemoteMuxFrame f = { chan, type, len };
+        txBuf.append((const char *)&f, sizeof(f));
+        if (data)
+            txBuf.append((const char *)data, len);
+    }
+    void openPending() {
+        char buf[16];
+        while (read(wake[0], buf, sizeof(buf))==sizeof(buf))
+            ;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &p: pending) {
+            addChannel(p.first, p.second);
+            frame(p.first, TCPREMOTE_MUX_OPEN, 0);
+        }
+        pending.clear();
+    }
+    void closeChannel(uint16_t id, bool tell) {
+        auto it = chans.find(id);
+        if (it==chans.end())
+            return;
+        close(it->second.fd);
+        chans.erase(it);
+        if (tell)
+            frame(id, TCPREMOTE_MUX_CLOSE, 0);
+    }
+    void sendTx() {
+        while (!txBuf.empty()) {
+            ssize_t n = send(sock, txBuf.data(), txBuf.size(), MSG_NOSIGNAL);
+            if (n<=0)
+                break;
+            txBuf.erase(0, n);
+        }
+    }
+    // read & dispatch frames from the peer, false at end of session
+    bool receive() {
+        char buf[65536];
+        ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n<0 && (EAGAIN==errno || EINTR==errno))
+            return true;
+        if (n<=0) {
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyMux: session closed: %s", n<0? strerror(errno): "EOF");
+            return false;
+        }
+        rxBuf.append(buf, n);
+        size_t off = 0;
+        while (rxBuf.size()-off>=sizeof(TCPRemoteMuxFrame)) {
+            TCPRemoteMuxFrame f;
+            memcpy(&f, &rxBuf[off], sizeof(f));
+            size_t plen = TCPREMOTE_MUX_DATA==f.type? f.len: 0;
+            // we never send longer, so waiting for one would only grow rxBuf for the peer
+            if (plen>TCPREMOTE_MUX_CHUNK) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux: channel %d frame too long: %d (out of sync?)", f.chan, (int)plen);
+                return false;
+            }
+            if (rxBuf.size()-off-sizeof(f)<plen)
+                break;
+            const char *payload = &rxBuf[off+sizeof(f)];
+            off += sizeof(f)+plen;
+            auto it = chans.find(f.chan);
+            switch (f.type) {
+            case TCPREMOTE_MUX_OPEN:
+                if (accept) {
+                    int sv[2];
+                    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)<0) {
+                        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux: socketpair: %s", strerror(errno));
+                        frame(f.chan, TCPREMOTE_MUX_CLOSE, 0);
+                        break;
+                    }
+                    addChannel(f.chan, sv[0]);
+                    accept(sv[1]);
+                }
+                break;
+            case TCPREMOTE_MUX_DATA:
+                if (it==chans.end())
+                    break;      // closed our end, discard
+                if (plen>it->second.granted) {
+                    SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux: channel %d exceeded its credit", f.chan);
+                    return false;
+                }
+                it->second.granted -= plen;
+                it->second.inQ.append(payload, plen);
+                break;
+            case TCPREMOTE_MUX_CREDIT:
+                if (it!=chans.end())
+                    it->second.credit += f.len;
+                break;
+            case TCPREMOTE_MUX_CLOSE:
+                // deliver anything still queued first
+                if (it!=chans.end() && !it->second.inQ.empty())
+                    it->second.closing = true;
+                else
+                    closeChannel(f.chan, false);
+                break;
+            default:
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyMux: unknown frame type %d (out of sync?)", f.type);
+                return false;
+            }
+        }
+        rxBuf.erase(0, off);
+        return true;
+    }
+    // move data between a channel's local socket and the session
+    void service(uint16_t id, short revents) {
+        auto it = chans.find(id);
+        if (it==chans.end())
+            return;
+        Channel &ch = it->second;
+        if ((revents & POLLOUT) && !ch.inQ.empty()) {
+            ssize_t n = send(ch.fd, ch.inQ.data(), ch.inQ.size(), MSG_NOSIGNAL);
+            if (n>0) {
+                ch.inQ.erase(0, n);
+                if (ch.closing && ch.inQ.empty()) {
+                    closeChannel(id, false);
+                    return;
+                }
+                // grant credit back in reasonable lumps
+                ch.consumed += n;
+                if (ch.consumed>=window/4) {
+                    frame(id, TCPREMOTE_MUX_CREDIT, ch.consumed);
+                    ch.granted += ch.consumed;
+                    ch.consumed = 0;
+                }
+            } else if (n<0 && errno!=EAGAIN) {
+                closeChannel(id, true);
+                return;
+            }
+        }
+        if (revents & (POLLIN|POLLHUP|POLLERR)) {
+            char buf[TCPREMOTE_MUX_CHUNK];
+            size_t max = ch.credit<sizeof(buf)? ch.credit: sizeof(buf);
+            ssize_t n = max>0? recv(ch.fd, buf, max, 0): -1;
+            if (n>0) {
+                ch.credit -= n;
+                frame(id, TCPREMOTE_MUX_DATA, n, buf);
+            } else if (0==n || (n<0 && errno!=EAGAIN && max>0)) {
+                // local end closed
+                closeChannel(id, true);
+            }
+        }
+    }
+};
+
+#endif
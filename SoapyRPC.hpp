@@ -7,10 +7,19 @@
 
 // This RPC implementation uses text I/O over TCP
 // in the tradition of many 'simple xxx' internet
-// protocols.
+// protocols, with an optional binary codec for speed.
 
 #include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <cstring>
+#include <deque>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <SoapySDR/Types.hpp>
 #include <SoapySDR/Logger.hpp>
 
 // map of format names to frame sizes
@@ -18,6 +27,32 @@ const std::map<std::string, size_t> g_frameSizes = {
     { "CS8", 2 }, { "CS16", 4 }, { "CF32", 8 },
 };
 
+// maximum deferred (pipelined) status replies in flight
+const size_t TCPREMOTE_MAX_DEFERRED = 256;
+
+// maximum operations in a TCPREMOTE_BATCH, or sensors in a TCPREMOTE_SUBSCRIBE_SENSORS
+// (servers refuse more, unread, which puts them out of sync with the client)
+const int TCPREMOTE_MAX_ITEMS = 1024;
+
+// protocol level, the reply to TCPREMOTE_GET_LEVEL (older servers refuse it, level 0). Unknown
+// RPCs are refused without reading their arguments, so clients check the level before using
+// any added since: 1 = TCPREMOTE_SET_CODEC, TCPREMOTE_DATA_SEND_BLOCKS (stream data in blocks,
+// see SoapyData.hpp), TCPREMOTE_BATCH & bandwidth API, 2 = hop schedules (dwell markers),
+// 3 = clocking & time API, 4 = sensor API & TCPREMOTE_SUBSCRIBE_SENSORS, 5 = TCPREMOTE_ACTIVATE_STREAM_AT,
+// 6 = TCPREMOTE_CLOCK_SYNC connections & server stamped stream blocks, 7 = striped data streams,
+// 8 = shared devices & TCPREMOTE_SET_ACCESS
+const int TCPREMOTE_PROTOCOL_LEVEL = 8;
+
+// layout version of the TCPREMOTE_DESCRIBE response, bump if changed
+const int TCPREMOTE_DESCRIBE_VERSION = 1;
+
+// device change events are sent on log streams as "E:<key>", where the key is
+// "<dir> <chn> <setting>", receivers discard anything held under that prefix.
+static inline std::string changeKey(int dir, int chn, const char *setting)
+{
+    return std::to_string(dir) + " " + std::to_string(chn) + " " + setting;
+}
+
 // RPC separator
 const std::string TCPREMOTE_RPC_SEP = "--";
 
@@ -29,6 +64,10 @@ enum
     TCPREMOTE_LOG_STREAM,
     TCPREMOTE_DATA_SEND,
     TCPREMOTE_DATA_RECV,
+    TCPREMOTE_LINK_PROBE,
+    TCPREMOTE_SESSION,
+    TCPREMOTE_CLOCK_SYNC,
+    TCPREMOTE_DATA_SEND_BLOCKS,
     // identification API
     TCPREMOTE_GET_HARDWARE_KEY = 10,
     TCPREMOTE_GET_HARDWARE_INFO,
@@ -148,6 +187,22 @@ enum
     TCPREMOTE_LIST_UARTS,
     TCPREMOTE_WRITE_UART,
     TCPREMOTE_READ_UART,
+    // internal special - codec negotiation
+    TCPREMOTE_SET_CODEC,
+    // internal special - all static capabilities in one response
+    TCPREMOTE_DESCRIBE,
+    // internal special - forward device change events to our log stream
+    TCPREMOTE_SUBSCRIBE_EVENTS,
+    // internal special - ordered list of setter operations, applied together
+    TCPREMOTE_BATCH,
+    // internal special - push sensor values to our log stream
+    TCPREMOTE_SUBSCRIBE_SENSORS,
+    // internal special - activateStream with flags, time & burst length
+    TCPREMOTE_ACTIVATE_STREAM_AT,
+    // internal special - ask for control of, or only to observe, a shared device
+    TCPREMOTE_SET_ACCESS,
+    // internal special - protocol level, takes no arguments so any server can answer
+    TCPREMOTE_GET_LEVEL,
     // internal special - dropping connection
     TCPREMOTE_DROP_RPC = 1000
 };
@@ -156,64 +211,196 @@ enum
 // - holds error state, to ensure no further I/O is attempted once errored,
 //   this allows strerror()/perror() to work despite subsequent rpc methods
 //   and allows error to be detected at the end of a series of rpc methods.
+// - buffers output until flush(), or the next read, so a whole request or
+//   response leaves in one syscall.
+// - two codecs: text (one value per line, easy to debug with netcat), and
+//   binary (fixed width native values, length prefixed strings, each flush
+//   sent as one length prefixed frame). Connections start in text mode,
+//   switching is negotiated with TCPREMOTE_SET_CODEC.
+// - reads block, unless a timeout is set (eg: during the connection handshake),
+//   expiry is an error like any other.
+// - integer status replies may be deferred, so a caller can pipeline requests
+//   without waiting. Each is numbered (responses arrive in request order), and
+//   all are collected before the next read, failures are logged & counted.
 class SoapyRPC
 {
 public:
     SoapyRPC(int socket) {
         hasError = false;
-        handle = fdopen(socket, "r+");
-        if (handle) {
-            setlinebuf(handle);
-            SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyRPC::<cons>(%d)", socket);
-        } else {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::<cons>, failed to fdopen socket: %s", strerror(errno));
-            hasError = true;
-        }
-    }
-    SoapyRPC(FILE *fp) {
-        hasError = false;
-        handle = fp;
-        setlinebuf(handle);
-        SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyRPC::<cons>(%p=>%d)", fp, fileno(fp));
+        binary = false;
+        sock = socket;
+        inPos = frameEnd = 0;
+        nextId = 0;
+        failed = 0;
+        collecting = false;
+        // we send whole requests/responses, so don't wait to coalesce them
+        int opt = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyRPC::<cons>(%d)", socket);
     }
     ~SoapyRPC() {
-        SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyRPC::<dest>(%d)", handle? fileno(handle): -1);
-        if (handle)
-            fclose(handle);
+        SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyRPC::<dest>(%d)", sock);
+        flush();
+        close(sock);
+    }
+    void setBinary(bool b) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyRPC::setBinary(%d)", b);
+        binary = b;
+    }
+    bool isBinary() const { return binary; }
+    // limit how long a read waits for the remote (msecs, 0 = forever)
+    void setTimeout(int msecs) {
+        struct timeval tv = { msecs/1000, (msecs%1000)*1000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    bool isError() const { return hasError; }
+    // mark buffered output, and discard back to a mark (eg: abandoning a partial response)
+    size_t mark() const { return outBuf.size(); }
+    void rewind(size_t m) { if (m<outBuf.size()) outBuf.resize(m); }
+    // unread input (another pipelined request/response)?
+    bool hasPending() const { return !hasError && inPos<inBuf.size(); }
+    // ..or anything (including EOF or an error) waiting on the socket, without blocking
+    bool hasInput() const {
+        if (hasError)
+            return false;
+        if (inPos<inBuf.size())
+            return true;
+        char c;
+        ssize_t n = recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n>=0 || (errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR);
+    }
+    // send the request now, collect its status reply later
+    void deferStatus(const std::string &what) {
+        deferred.push_back(std::make_pair(++nextId, what));
+        flush();
+        // bound the requests in flight, so neither end blocks on a full socket,
+        // collecting the oldest half (most likely already arrived) keeps the pipe full
+        if (deferred.size()>=TCPREMOTE_MAX_DEFERRED)
+            collectDeferred(TCPREMOTE_MAX_DEFERRED/2);
+    }
+    // collect deferred status replies down to keep outstanding, returns number that failed
+    int collectDeferred(size_t keep = 0) {
+        int nfail = 0;
+        collecting = true;
+        while (deferred.size()>keep && !hasError) {
+            std::pair<uint32_t, std::string> d = deferred.front();
+            deferred.pop_front();
+            int status = readInteger();
+            if (status<0) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC: deferred request #%u (%s) failed: %d",
+                    d.first, d.second.c_str(), status);
+                lastError = "#" + std::to_string(d.first) + " " + d.second + ": " + std::to_string(status);
+                ++nfail;
+            }
+        }
+        collecting = false;
+        failed += nfail;
+        return nfail;
+    }
+    size_t numDeferred() const { return deferred.size(); }
+    int numFailed() const { return failed; }
+    const std::string &getLastError() const { return lastError; }
+    int flush() {
+        if (hasError) return -1;
+        if (outBuf.empty()) return 0;
+        // binary frames are prefixed with the length
+        uint32_t len = outBuf.size();
+        struct iovec iov[2];
+        iov[0].iov_base = &len;
+        iov[0].iov_len = binary? sizeof(len): 0;
+        iov[1].iov_base = &outBuf[0];
+        iov[1].iov_len = outBuf.size();
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        int total = iov[0].iov_len + iov[1].iov_len;
+        while (msg.msg_iovlen>0) {
+            ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+            if (n<0 && EINTR==errno)
+                continue;
+            if (n<0) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::flush: %s", strerror(errno));
+                hasError = true;
+                return -1;
+            }
+            while (msg.msg_iovlen>0 && (size_t)n>=msg.msg_iov->iov_len) {
+                n -= msg.msg_iov->iov_len;
+                ++msg.msg_iov;
+                --msg.msg_iovlen;
+            }
+            if (msg.msg_iovlen>0) {
+                msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+                msg.msg_iov->iov_len -= n;
+            }
+        }
+        outBuf.clear();
+        return total;
     }
     int writeInteger(const int i) {
         if (hasError) return -1;
         SoapySDR_logf(SOAPY_SDR_TRACE, "Wi %d", i);
-        int r = fprintf(handle, "%d\n", i);
-        if (r<0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::writeInteger: %s", strerror(errno));
-            hasError = true;
+        if (binary) {
+            int32_t v = i;
+            outBuf.append((const char *)&v, sizeof(v));
+            return sizeof(v);
         }
+        char line[16];
+        int r = snprintf(line, sizeof(line), "%d\n", i);
+        outBuf.append(line, r);
         return r;
     }
     int writeDouble(const double d) {
         if (hasError) return -1;
         SoapySDR_logf(SOAPY_SDR_TRACE, "Wd %f", d);
-        int r = fprintf(handle, "%f\n", d);
-        if (r<0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::writeDouble %s", strerror(errno));
-            hasError = true;
+        if (binary) {
+            outBuf.append((const char *)&d, sizeof(d));
+            return sizeof(d);
         }
+        // enough digits to round trip exactly
+        char line[32];
+        int r = snprintf(line, sizeof(line), "%.17g\n", d);
+        outBuf.append(line, r);
         return r;
     }
-    int writeString(const std::string s) {
+    int writeLong(const long long l) {
         if (hasError) return -1;
-        SoapySDR_logf(SOAPY_SDR_TRACE, "Ws %s", s.c_str());
-        int r = fprintf(handle, "%s\n", s.c_str());
-        if (r<0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::writeString: %s", strerror(errno));
-            hasError = true;
+        SoapySDR_logf(SOAPY_SDR_TRACE, "Wl %lld", l);
+        if (binary) {
+            int64_t v = l;
+            outBuf.append((const char *)&v, sizeof(v));
+            return sizeof(v);
         }
+        char line[24];
+        int r = snprintf(line, sizeof(line), "%lld\n", l);
+        outBuf.append(line, r);
         return r;
     }
+    int writeString(const std::string &s) {
+        if (hasError) return -1;
+        SoapySDR_logf(SOAPY_SDR_TRACE, "Ws %s", s.c_str());
+        if (binary) {
+            uint32_t len = s.length();
+            outBuf.append((const char *)&len, sizeof(len));
+            outBuf.append(s);
+            return sizeof(len)+len;
+        }
+        outBuf.append(s);
+        outBuf += '\n';
+        return s.length()+1;
+    }
     int writeKwargs(const SoapySDR::Kwargs &args) {
         if (hasError) return -1;
         int n = 0, r;
+        if (binary) {
+            // count, then name/value pairs
+            n = writeInteger(args.size());
+            for (auto it=args.begin(); it!=args.end(); ++it) {
+                n += writeString(it->first);
+                n += writeString(it->second);
+            }
+            return n;
+        }
         for (auto it=args.begin(); it!=args.end(); ++it) {
             std::string nv;
             nv += it->first;
@@ -233,6 +420,13 @@ public:
     int writeStrVector(const std::vector<std::string> &vec) {
         if (hasError) return -1;
         int n = 0, r;
+        if (binary) {
+            // count, then strings
+            n = writeInteger(vec.size());
+            for (auto &it: vec)
+                n += writeString(it);
+            return n;
+        }
         for (auto it: vec) {
             r = writeString(it);
             if (r<0)
@@ -245,9 +439,33 @@ public:
         n += r;
         return n;
     }
+    int writeRange(const SoapySDR::Range &r) {
+        if (hasError) return -1;
+        int n = writeDouble(r.minimum());
+        n += writeDouble(r.maximum());
+        n += writeDouble(r.step());
+        return n;
+    }
+    int writeRangeList(const SoapySDR::RangeList &list) {
+        if (hasError) return -1;
+        int n = 0;
+        for (auto &r: list)
+            n += writeRange(r);
+        // terminator, step<0
+        n += writeRange(SoapySDR::Range(0, 0, -1.0));
+        return n;
+    }
     int readInteger() {
         if (hasError) return -1;
+        if (!deferred.empty() && !collecting) collectDeferred();
         int rv=-1;
+        if (binary) {
+            int32_t v;
+            if (readBinary(&v, sizeof(v)))
+                rv = v;
+            SoapySDR_logf(SOAPY_SDR_TRACE, "Ri %d", rv);
+            return rv;
+        }
         std::string s = readString();
         if (s.length()>0)
             sscanf(s.c_str(), "%d", &rv);
@@ -257,7 +475,13 @@ public:
     }
     double readDouble() {
         if (hasError) return -1;
+        if (!deferred.empty() && !collecting) collectDeferred();
         double rv=NAN;
+        if (binary) {
+            readBinary(&rv, sizeof(rv));
+            SoapySDR_logf(SOAPY_SDR_TRACE, "Rd %f", rv);
+            return rv;
+        }
         std::string s = readString();
         if (s.length()>0)
             sscanf(s.c_str(), "%lf", &rv);
@@ -265,16 +489,49 @@ public:
             SoapySDR_log(SOAPY_SDR_ERROR, "SoapyRPC::readDouble, empty line");
         return rv;
     }
+    long long readLong() {
+        if (hasError) return -1;
+        if (!deferred.empty() && !collecting) collectDeferred();
+        long long rv=-1;
+        if (binary) {
+            int64_t v;
+            if (readBinary(&v, sizeof(v)))
+                rv = v;
+            SoapySDR_logf(SOAPY_SDR_TRACE, "Rl %lld", rv);
+            return rv;
+        }
+        std::string s = readString();
+        if (s.length()>0)
+            sscanf(s.c_str(), "%lld", &rv);
+        else
+            SoapySDR_log(SOAPY_SDR_ERROR, "SoapyRPC::readLong, empty line");
+        return rv;
+    }
     std::string readString() {
-        char line[256];
         std::string rv;
         if (hasError) return rv;
-        if (fgets(line, sizeof(line), handle)) {
-            line[strlen(line)-1] = 0;
-            rv = line;
+        if (!deferred.empty() && !collecting) collectDeferred();
+        if (binary) {
+            uint32_t len = 0;
+            if (readBinary(&len, sizeof(len)) && len>0) {
+                if (inPos+len>frameEnd) {
+                    SoapySDR_log(SOAPY_SDR_ERROR, "SoapyRPC::readString: string overruns frame");
+                    hasError = true;
+                } else {
+                    rv.assign(inBuf, inPos, len);
+                    inPos += len;
+                }
+            }
         } else {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::readString: %s", strerror(errno));
-            hasError = true;
+            flush();
+            // find a whole line
+            size_t eol;
+            while ((eol=inBuf.find('\n', inPos))==std::string::npos) {
+                if (!fill())
+                    return rv;
+            }
+            rv.assign(inBuf, inPos, eol-inPos);
+            inPos = eol+1;
         }
         SoapySDR_logf(SOAPY_SDR_TRACE, "R '%s'", rv.c_str());
         return rv;
@@ -282,6 +539,15 @@ public:
     SoapySDR::Kwargs readKwargs() {
         SoapySDR::Kwargs args;
         if (hasError) return args;
+        if (!deferred.empty() && !collecting) collectDeferred();
+        if (binary) {
+            int cnt = readInteger();
+            for (int i=0; i<cnt && !hasError; ++i) {
+                std::string n = readString();
+                args[n] = readString();
+            }
+            return args;
+        }
         while (true) {
             std::string nv = readString();
             if (nv.length()<2)      // '=' or empty is a terminator
@@ -295,9 +561,34 @@ public:
         }
         return args;
     }
+    SoapySDR::Range readRange() {
+        // NB: sequenced reads, argument evaluation order is unspecified
+        double beg = readDouble();
+        double end = readDouble();
+        double step = readDouble();
+        return SoapySDR::Range(beg, end, step);
+    }
+    SoapySDR::RangeList readRangeList() {
+        // read triplets of beg/end/step until step<0
+        SoapySDR::RangeList list;
+        while (!hasError) {
+            SoapySDR::Range r = readRange();
+            if (r.step()<0)
+                break;
+            list.push_back(r);
+        }
+        return list;
+    }
     std::vector<std::string> readStrVector() {
         std::vector<std::string> list;
         if (hasError) return list;
+        if (!deferred.empty() && !collecting) collectDeferred();
+        if (binary) {
+            int cnt = readInteger();
+            for (int i=0; i<cnt && !hasError; ++i)
+                list.push_back(readString());
+            return list;
+        }
         while (true) {
             // blank/error indicates end of list
             std::string str = readString();
@@ -309,8 +600,70 @@ public:
     }
 
 private:
-    FILE *handle;
+    int sock;
     bool hasError;
+    bool binary;
+    // pending output, buffered input, read position & end of current binary frame
+    std::string outBuf;
+    std::string inBuf;
+    size_t inPos;
+    size_t frameEnd;
+    // deferred status replies (request number, description), failure count & last
+    std::deque<std::pair<uint32_t, std::string>> deferred;
+    uint32_t nextId;
+    int failed;
+    bool collecting;
+    std::string lastError;
+
+    // read whatever is available from the socket (blocking if nothing)
+    bool fill() {
+        // discard consumed input first (the remote may always be ahead of us, so the
+        // buffer is never completely consumed), keeping the current frame end in step
+        if (inPos>0) {
+            inBuf.erase(0, inPos);
+            frameEnd = frameEnd>inPos? frameEnd-inPos: 0;
+            inPos = 0;
+        }
+        char buf[65536];
+        ssize_t n;
+        do {
+            n = recv(sock, buf, sizeof(buf), 0);
+        } while (n<0 && EINTR==errno);
+        if (n<=0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyRPC::fill: %s", 0==n? "EOF":
+                (EAGAIN==errno || EWOULDBLOCK==errno)? "timed out": strerror(errno));
+            hasError = true;
+            return false;
+        }
+        inBuf.append(buf, n);
+        return true;
+    }
+    // read len bytes of the current binary frame, fetching the next frame if required
+    bool readBinary(void *dst, size_t len) {
+        flush();
+        if (inPos>=frameEnd) {
+            uint32_t flen;
+            while (inBuf.size()-inPos<sizeof(flen)) {
+                if (!fill())
+                    return false;
+            }
+            memcpy(&flen, &inBuf[inPos], sizeof(flen));
+            inPos += sizeof(flen);
+            while (inBuf.size()-inPos<flen) {
+                if (!fill())
+                    return false;
+            }
+            frameEnd = inPos+flen;
+        }
+        if (inPos+len>frameEnd) {
+            SoapySDR_log(SOAPY_SDR_ERROR, "SoapyRPC::readBinary: value overruns frame");
+            hasError = true;
+            return false;
+        }
+        memcpy(dst, &inBuf[inPos], len);
+        inPos += len;
+        return true;
+    }
 };
 
 #endif
@@ -0,0 +1,170 @@
+// SoapyReactor.hpp - epoll event loop for the server main thread
+// Copyright (c) 2021 Phil Ashby
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SoapyReactor_hpp
+#define SoapyReactor_hpp
+
+// Each file descriptor is registered once with a handler, called from run()
+// with the epoll events when it becomes ready. Registration is edge triggered:
+// handlers must consume everything available (or be happy to wait for more to
+// arrive) before returning. Timers are timerfds registered the same way, and
+// other threads may post() work to run on the loop, woken via an eventfd.
+// Everything else (add/remove/timer/cancel/stop) is for the loop thread only.
+// NB: Linux only (epoll, timerfd, eventfd).
+
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <SoapySDR/Logger.hpp>
+
+class SoapyReactor
+{
+public:
+    typedef std::function<void(uint32_t)> Handler;
+
+    SoapyReactor(): nextGen(0), quit(false), result(0) {
+        efd = epoll_create1(EPOLL_CLOEXEC);
+        wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd<0 || wake<0)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyReactor: %s", strerror(errno));
+        add(wake, [this](uint32_t) { runPosted(); });
+    }
+    ~SoapyReactor() {
+        for (auto &it: timers)
+            close(it.first);
+        close(wake);
+        close(efd);
+    }
+    // register fd (once), handler is called with the events each time it becomes ready
+    bool add(int fd, Handler fn, uint32_t events = EPOLLIN) {
+        Entry &ent = fds[fd];
+        ent.gen = ++nextGen;
+        ent.fn = fn;
+        struct epoll_event ev;
+        ev.events = events | EPOLLET;
+        ev.data.u64 = ((uint64_t)ent.gen<<32) | (uint32_t)fd;
+        if (epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev)<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyReactor::add(%d): %s", fd, strerror(errno));
+            fds.erase(fd);
+            return false;
+        }
+        return true;
+    }
+    // unregister fd, before it is closed (events already collected for it are dropped)
+    void remove(int fd) {
+        if (fds.erase(fd))
+            epoll_ctl(efd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    // call fn after msecs (& every msecs if repeat), returns the timer id for cancel() (-1 on error)
+    int timer(long msecs, std::function<void()> fn, bool repeat = false) {
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyReactor::timer: %s", strerror(errno));
+            return -1;
+        }
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = msecs/1000;
+        its.it_value.tv_nsec = (msecs%1000)*1000000 + (msecs>0? 0: 1);
+        if (repeat)
+            its.it_interval = its.it_value;
+        timerfd_settime(tfd, 0, &its, nullptr);
+        timers[tfd] = repeat;
+        add(tfd, [this, tfd, fn](uint32_t) {
+            uint64_t n;
+            if (read(tfd, &n, sizeof(n))!=sizeof(n))
+                return;
+            if (!timers[tfd])
+                cancel(tfd);
+            fn();
+        });
+        return tfd;
+    }
+    void cancel(int id) {
+        if (timers.erase(id)) {
+            remove(id);
+            close(id);
+        }
+    }
+    // run fn on the loop thread, safe to call from any thread
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            posted.push_back(fn);
+        }
+        uint64_t one = 1;
+        if (write(wake, &one, sizeof(one))<0)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyReactor::post: %s", strerror(errno));
+    }
+    // make run() return rv once the current handler completes
+    void stop(int rv = 0) {
+        result = rv;
+        quit = true;
+    }
+    // event loop, returns the value given to stop(), or -1 on error
+    int run() {
+        struct epoll_event evs[64];
+        while (!quit) {
+            int n = epoll_wait(efd, evs, 64, -1);
+            if (n<0) {
+                if (EINTR==errno)
+                    continue;
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyReactor: epoll_wait: %s", strerror(errno));
+                return -1;
+            }
+            for (int idx=0; idx<n && !quit; ++idx) {
+                int fd = (int)(evs[idx].data.u64 & 0xffffffff);
+                uint32_t gen = (uint32_t)(evs[idx].data.u64>>32);
+                // skip anything removed (or removed & its fd reused) by an earlier handler
+                auto it = fds.find(fd);
+                if (it==fds.end() || it->second.gen!=gen)
+                    continue;
+                // copy, the handler may remove itself
+                Handler fn = it->second.fn;
+                fn(evs[idx].events);
+            }
+        }
+        return result;
+    }
+
+private:
+    struct Entry
+    {
+        uint32_t gen;
+        Handler fn;
+    };
+    int efd, wake;
+    std::map<int, Entry> fds;
+    // timer fds, & whether each repeats
+    std::map<int, bool> timers;
+    uint32_t nextGen;
+    bool quit;
+    int result;
+    // work posted from other threads
+    std::mutex mutex;
+    std::vector<std::function<void()>> posted;
+
+    void runPosted() {
+        uint64_t n;
+        if (read(wake, &n, sizeof(n))<0 && errno!=EAGAIN)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyReactor: eventfd: %s", strerror(errno));
+        std::vector<std::function<void()>> work;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            work.swap(posted);
+        }
+        for (auto &fn: work)
+            fn();
+    }
+};
+
+#endif
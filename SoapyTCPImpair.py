@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+#  SoapyTCPImpair.py
+#  Copyright (c) 2021 Phil Ashby
+#  SPDX-License-Identifier: BSL-1.0
+#
+#  Loopback network impairment shim, for checking tcpremote:stripes (and tcpremote:adapt) without a real network or netem.
+#  Relays every connection to a local server, capping each one at <rate> bytes/sec server->client, with random stalls (as a
+#  TCP flow recovering from loss), client->server is passed through untouched. Point the client at <listen port>, eg:
+#    python3 SoapyTCPImpair.py 20700 20655 1500000 0.01 0.2
+
+import asyncio
+import random
+import sys
+import time
+
+if len(sys.argv) != 6:
+    sys.exit('usage: SoapyTCPImpair.py <listen port> <server port> <rate: bytes/sec per connection> <stall probability> <stall secs>')
+LPORT, SPORT, RATE, STALLP, STALLS = int(sys.argv[1]), int(sys.argv[2]), float(sys.argv[3]), float(sys.argv[4]), float(sys.argv[5])
+
+async def plain(r, w):
+    try:
+        while True:
+            d = await r.read(65536)
+            if not d:
+                break
+            w.write(d)
+            await w.drain()
+    finally:
+        w.close()
+
+async def shaped(r, w):
+    # pace by a virtual clock, so stalls and slow reads are not made up for later
+    t = time.monotonic()
+    try:
+        while True:
+            d = await r.read(16384)
+            if not d:
+                break
+            if random.random() < STALLP:
+                await asyncio.sleep(STALLS)
+            t = max(t, time.monotonic()) + len(d)/RATE
+            dt = t - time.monotonic()
+            if dt > 0:
+                await asyncio.sleep(dt)
+            w.write(d)
+            await w.drain()
+    finally:
+        w.close()
+
+async def relay(cr, cw):
+    try:
+        sr, sw = await asyncio.open_connection('127.0.0.1', SPORT)
+    except OSError:
+        cw.close()
+        return
+    await asyncio.gather(plain(cr, sw), shaped(sr, cw), return_exceptions=True)
+
+async def main():
+    srv = await asyncio.start_server(relay, '127.0.0.1', LPORT)
+    async with srv:
+        await srv.serve_forever()
+
+asyncio.run(main())
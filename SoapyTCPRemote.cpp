@@ -3,12 +3,20 @@
 //  SPDX-License-Identifier: BSL-1.0
 
 #include "SoapyTCPRemote.hpp"
+#include "SoapyData.hpp"
 #include "SoapyLog.hpp"
+#include "SoapyBuffer.hpp"
 
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <time.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 
 // declare the contents of a Stream object for ourselves
@@ -16,77 +24,383 @@ class SoapySDR::Stream
 {
 public:
     int netSock;
+    // all data connections of a striped stream (the first is netSock), each with any block
+    // header read ahead while waiting its turn, & bytes received (total, at the last stats)
+    struct Stripe
+    {
+        int sock;
+        bool ahead;
+        TCPRemoteBlock block;
+        unsigned long long bytes;
+        unsigned long long statBytes;
+    };
+    std::vector<Stripe> stripes;
+    long long statAt;
+    // which has the current block, & the next block sequence number
+    size_t cur;
+    uint32_t nextSeq;
     int remoteId;
     int numChans;
     size_t fSize;
     bool running;
+    // when activated (CLOCK_MONOTONIC usecs), until the first samples are read
+    long long actAt;
+    // activated for a finite burst, which stops the stream when it ends
+    bool burst;
+    // requested & wire formats, as we may choose smaller native format
+    std::string fmtOut;
+    std::string fmtWire;
+    // received in blocks (else the original unframed stream, from older remotes)
+    bool framed;
+    // current data block header & payload bytes remaining
+    TCPRemoteBlock block;
+    size_t left;
+    // repeats still owed of the last decimated sample (in fmtOut, per channel)
+    size_t repeat;
+    std::vector<uint8_t> held;
+    // receive & conversion buffers (see tcpremote:buffers)
+    SoapyBuffer rxBuf;
+    SoapyBuffer cvBuf;
 };
 
-SoapyTCPRemote::SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs) :
+SoapyTCPRemote::SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs, const SoapySDR::Kwargs &args) :
     remoteAddress(address),
     remotePort(port),
     remoteDriver(remdriver),
-    remoteArgs(remargs)
+    remoteArgs(remargs),
+    mux(nullptr),
+    connectTimeout(TCPREMOTE_CONNECT_TIMEOUT),
+    peerLen(0),
+    rpc(nullptr),
+    log(nullptr),
+    logState(LOG_CONNECTING),
+    linkRate(0),
+    linkRtt(0),
+    rateRefuse(false),
+    async(false),
+    remoteLevel(0),
+    access("shared"),
+    useCache(true),
+    described(false),
+    dynEvents(false),
+    dynGen(0),
+    cmdTimed(false),
+    sensorInterval(1000),
+    clockInterval(TCPREMOTE_CLOCK_INTERVAL),
+    clockSock(-1),
+    clockStop(false),
+    clockValid(false),
+    clockOffset(0),
+    clockDrift(0),
+    clockAt(0),
+    clockRtt(0),
+    clockLocal(false),
+    latencyValid(false),
+    latencyNs(0),
+    activateUs(-1),
+    firstSampleUs(-1)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::<cons>(%s,%s,%s,%s)",
         address.c_str(), port.c_str(), remdriver.c_str(), remargs.c_str());
-    int status = connectLogStream(detectLogLevel());
-    if (status<0)
-        throw std::runtime_error("unable to connect log stream");
+    if (args.find("tcpremote:connect_timeout")!=args.end())
+        connectTimeout = atoi(args.at("tcpremote:connect_timeout").c_str());
+    // optionally carry everything over one connection
+    if (args.find("tcpremote:session")!=args.end() && args.at("tcpremote:session")=="true") {
+        size_t window = TCPREMOTE_MUX_WINDOW;
+        if (args.find("tcpremote:session_window")!=args.end())
+            window = strtoul(args.at("tcpremote:session_window").c_str(), nullptr, 10);
+        if (connectSession(window)<0)
+            throw std::runtime_error("unable to connect session");
+    }
+    // the log stream connects on its own thread while we connect RPC and load the driver,
+    // we only hold the load request until the log request is sent, so the remote sets up
+    // the log stream first and we see messages from the driver load.
+    logThread = std::thread(processLogStream, this, detectLogLevel());
     int sock = connect();
-    if (sock<0)
-        throw std::runtime_error("unable to connect to remote");
-    rpc = new SoapyRPC(sock);
-    status = loadRemoteDriver();
-    if (status<0)
-        throw std::runtime_error("unable to load remote driver");
+    int status = -1;
+    if (sock>=0 && waitLogState(LOG_REQUESTED)>=0) {
+        rpc = new SoapyRPC(sock);
+        status = loadRemoteDriver();
+    } else if (sock>=0) {
+        close(sock);
+    }
+    const char *err = nullptr;
+    if (waitLogState(LOG_READY)<0)
+        err = "unable to connect log stream";
+    else if (sock<0)
+        err = "unable to connect to remote";
+    else if (status<0)
+        err = "unable to load remote driver";
+    if (err) {
+        delete rpc;
+        closeLogStream();
+        delete mux;
+        throw std::runtime_error(err);
+    }
+    // learn the remote protocol level, then switch to binary RPC unless asked not to. Older
+    // servers refuse the level request (level 0) and we stay in text without asking for more,
+    // as they would not read the codec. Don't wait forever on a remote that says nothing.
+    std::string codec = "binary";
+    if (args.find("tcpremote:codec")!=args.end())
+        codec = args.at("tcpremote:codec");
+    rpc->setTimeout(connectTimeout);
+    if (getLevel()>0 && codec!="text")
+        setCodec(codec);
+    rpc->setTimeout(0);
+    if (rpc->isError()) {
+        delete rpc;
+        rpc = nullptr;
+        // nor will it answer on the log stream
+        shutdown(fileno(log), SHUT_RDWR);
+        closeLogStream();
+        delete mux;
+        throw std::runtime_error("no response from remote");
+    }
+    // control of (or only to observe) the remote device, other clients may share it
+    if (args.find("tcpremote:access")!=args.end() && setAccess(args.at("tcpremote:access"))<0
+        && "control"==args.at("tcpremote:access")) {
+        std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+        rpc->writeString(TCPREMOTE_RPC_SEP);
+        rpc->writeInteger(TCPREMOTE_DROP_RPC);
+        delete rpc;
+        rpc = nullptr;
+        closeLogStream();
+        delete mux;
+        throw std::runtime_error("unable to take control of remote device");
+    }
+    // pipeline setters, collecting their status later?
+    if (args.find("tcpremote:async")!=args.end())
+        async = args.at("tcpremote:async")=="true";
+    // fetch & cache static capabilities in one round trip
+    if (args.find("tcpremote:cache")!=args.end())
+        useCache = args.at("tcpremote:cache")!="false";
+    if (useCache)
+        describe();
+    // cache dynamic settings, if the remote can tell us when they change
+    parsePolicy(args.find("tcpremote:cache_policy")!=args.end()? args.at("tcpremote:cache_policy"): "");
+    for (auto &it: dynPolicy) {
+        if (it.second!=CACHE_OFF) {
+            subscribeEvents();
+            break;
+        }
+    }
+    // optional link probe, and what to do with sample rates it cannot carry
+    if (args.find("tcpremote:rate_check")!=args.end())
+        rateRefuse = args.at("tcpremote:rate_check")=="refuse";
+    if (args.find("tcpremote:probe")!=args.end())
+        probeLink(atoi(args.at("tcpremote:probe").c_str()));
+    // sensors to have pushed to us
+    if (args.find("tcpremote:sensor_interval")!=args.end())
+        sensorInterval = atoi(args.at("tcpremote:sensor_interval").c_str());
+    if (args.find("tcpremote:sensors")!=args.end())
+        subscribeSensors(args.at("tcpremote:sensors"));
+    // clock sync, to relate stream times the server stamps to our own clock
+    if (args.find("tcpremote:clock_local")!=args.end())
+        clockLocal = args.at("tcpremote:clock_local")=="true";
+    if (args.find("tcpremote:clock_sync")!=args.end())
+        clockInterval = atoi(args.at("tcpremote:clock_sync").c_str());
+    if (clockInterval>0)
+        startClockSync();
 }
 
 SoapyTCPRemote::~SoapyTCPRemote()
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::<dest>");
+    stopClockSync();
     if (rpc) {
+        std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
         rpc->writeString(TCPREMOTE_RPC_SEP);
         rpc->writeInteger(TCPREMOTE_DROP_RPC);
         delete rpc;
         rpc = nullptr;
     }
-    if (log) {
-        // writing to this stream terminates it via the remote end
-        write(fileno(log), "\n", 1);
-        logThread.join();
-    }
+    closeLogStream();
+    delete mux;
 }
 
-// private connector method
+// private connector methods
 int SoapyTCPRemote::connect() const
 {
-    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::connect()");
-    // create new socket
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "Unable to create socket: %s", strerror(errno));
-        return -1;
-    }
-    // resolve address (or parse)
-    struct addrinfo *res = nullptr;
-    if (getaddrinfo(remoteAddress.c_str(), remotePort.c_str(), nullptr, &res)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "Failed to resolve address/port: %s/%s: %s",
-            remoteAddress.c_str(), remotePort.c_str(), strerror(errno));
+    if (mux)
+        return mux->open();
+    return connectTCP();
+}
+
+int SoapyTCPRemote::connectSession(size_t window)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::connectSession(%d)", (int)window);
+    int sock = connectTCP();
+    if (sock<0)
+        return sock;
+    // identify as a session with our window, then it's all frames
+    char req[32];
+    int rlen = sprintf(req, "%d\n%d\n", TCPREMOTE_SESSION, (int)window);
+    if (write(sock, req, rlen)!=rlen) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::connectSession, failed to write request: %s", strerror(errno));
         close(sock);
         return -1;
     }
-    // attempt connection to remote server
-    if (::connect(sock, res->ai_addr, res->ai_addrlen)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "Failed to connect to address/port: %s/%s: %s",
-            remoteAddress.c_str(), remotePort.c_str(), strerror(errno));
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    mux = new SoapyMux(sock, window);
+    mux->start();
+    return 0;
+}
+
+static long long monotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+static long long monotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+// our clock for stream timestamps & clock sync (nsecs), as the server's
+static long long realtimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+// Happy Eyeballs (RFC8305): try every resolved address, alternating address families,
+// starting the next attempt if the last has not connected within a short delay (or
+// straight away if it failed), first to connect wins and the rest are dropped.
+int SoapyTCPRemote::connectTCP() const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::connectTCP()");
+    std::vector<std::pair<struct sockaddr_storage, socklen_t>> addrs;
+    bool known = false;
+    {
+        std::lock_guard<std::mutex> lock(peerMutex);
+        if (peerLen>0) {
+            addrs.push_back(std::make_pair(peerAddr, peerLen));
+            known = true;
+        }
+    }
+    if (!known) {
+        // resolve address (or parse)
+        struct addrinfo hints, *res = nullptr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int rv = getaddrinfo(remoteAddress.c_str(), remotePort.c_str(), &hints, &res);
+        if (rv) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "Failed to resolve address/port: %s/%s: %s",
+                remoteAddress.c_str(), remotePort.c_str(), gai_strerror(rv));
+            return -1;
+        }
+        // interleave families, starting with the resolver's preference
+        std::vector<struct addrinfo *> fam[2];
+        for (struct addrinfo *ai=res; ai; ai=ai->ai_next)
+            fam[ai->ai_family!=res->ai_family].push_back(ai);
+        for (size_t idx=0; idx<fam[0].size() || idx<fam[1].size(); ++idx) {
+            for (int f=0; f<2; ++f) {
+                if (idx>=fam[f].size())
+                    continue;
+                struct sockaddr_storage sa;
+                memcpy(&sa, fam[f][idx]->ai_addr, fam[f][idx]->ai_addrlen);
+                addrs.push_back(std::make_pair(sa, fam[f][idx]->ai_addrlen));
+            }
+        }
         freeaddrinfo(res);
-        close(sock);
-        return -1;
     }
-    freeaddrinfo(res);
-    SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: connected: %s/%s",
-            remoteAddress.c_str(), remotePort.c_str());
+    // race connection attempts
+    std::vector<struct pollfd> pfds;
+    std::vector<size_t> tried;
+    size_t next = 0, won = 0;
+    int sock = -1, err = ETIMEDOUT;
+    long long now = monotonicMs();
+    long long deadline = now + connectTimeout, start = now;
+    while (sock<0) {
+        now = monotonicMs();
+        if (now>=deadline)
+            break;
+        if (next<addrs.size() && (now>=start || pfds.empty())) {
+            const struct sockaddr *sa = (const struct sockaddr *)&addrs[next].first;
+            int s = socket(sa->sa_family, SOCK_STREAM, 0);
+            if (s<0) {
+                err = errno;
+                ++next;
+                continue;
+            }
+            fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+            if (0==::connect(s, sa, addrs[next].second)) {
+                sock = s;
+                won = next;
+            } else if (EINPROGRESS==errno) {
+                pfds.push_back({ s, POLLOUT, 0 });
+                tried.push_back(next);
+            } else {
+                // failed already, try the next straight away
+                err = errno;
+                close(s);
+                ++next;
+                continue;
+            }
+            ++next;
+            start = now + TCPREMOTE_CONNECT_DELAY;
+            continue;
+        }
+        if (pfds.empty())
+            break;
+        long long until = next<addrs.size() && start<deadline? start: deadline;
+        if (poll(pfds.data(), pfds.size(), (int)(until-now))<0 && errno!=EINTR) {
+            err = errno;
+            break;
+        }
+        for (size_t idx=0; idx<pfds.size() && sock<0; ) {
+            if (!pfds[idx].revents) {
+                ++idx;
+                continue;
+            }
+            int serr = 0;
+            socklen_t slen = sizeof(serr);
+            getsockopt(pfds[idx].fd, SOL_SOCKET, SO_ERROR, &serr, &slen);
+            if (!serr) {
+                sock = pfds[idx].fd;
+                won = tried[idx];
+            } else {
+                // failed, no need to wait before the next
+                err = serr;
+                close(pfds[idx].fd);
+                start = now;
+            }
+            pfds.erase(pfds.begin()+idx);
+            tried.erase(tried.begin()+idx);
+        }
+    }
+    for (auto &p: pfds)
+        close(p.fd);
+    if (sock<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Failed to connect to address/port: %s/%s: %s",
+            remoteAddress.c_str(), remotePort.c_str(), strerror(err));
+        if (!known)
+            return -1;
+        // the address we knew no longer answers, start again
+        {
+            std::lock_guard<std::mutex> lock(peerMutex);
+            peerLen = 0;
+        }
+        return connectTCP();
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+    if (!known) {
+        std::lock_guard<std::mutex> lock(peerMutex);
+        peerAddr = addrs[won].first;
+        peerLen = addrs[won].second;
+    }
+    char host[NI_MAXHOST];
+    if (getnameinfo((struct sockaddr *)&addrs[won].first, addrs[won].second, host, sizeof(host), nullptr, 0, NI_NUMERICHOST))
+        strcpy(host, "?");
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: connected: %s/%s (%s, %d of %d)",
+            remoteAddress.c_str(), remotePort.c_str(), host, (int)won+1, (int)addrs.size());
     return sock;
 }
 
@@ -100,6 +414,54 @@ int SoapyTCPRemote::loadRemoteDriver() const
     return rpc->readInteger();
 }
 
+int SoapyTCPRemote::getLevel()
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getLevel()");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_LEVEL);
+    int level = rpc->readInteger();
+    remoteLevel = level>0? level: 0;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: remote protocol level %d", remoteLevel);
+    return remoteLevel;
+}
+
+int SoapyTCPRemote::setCodec(const std::string &codec)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setCodec(%s)", codec.c_str());
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_CODEC);
+    rpc->writeString(codec);
+    int status = rpc->readInteger();
+    if (status<0) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: remote refused codec %s (%d), using text", codec.c_str(), status);
+        return status;
+    }
+    rpc->setBinary("binary"==codec);
+    return 0;
+}
+
+int SoapyTCPRemote::setAccess(const std::string &want)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setAccess(%s)", want.c_str());
+    if (remoteLevel<8) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "SoapyTCPRemote: remote does not share devices, ignoring %s access", want.c_str());
+        return -1;
+    }
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_ACCESS);
+    rpc->writeString(want);
+    int status = rpc->readInteger();
+    if (status<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote: remote refused %s access (%d)", want.c_str(), status);
+        return status;
+    }
+    access = want;
+    return 0;
+}
+
 int SoapyTCPRemote::connectLogStream(SoapySDRLogLevel level)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::connectLogStream");
@@ -110,11 +472,13 @@ int SoapyTCPRemote::connectLogStream(SoapySDRLogLevel level)
     log = fdopen(sock, "r+");
     if (!log) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "fdopen() log stream: %s", strerror(errno));
+        close(sock);
         return -1;
     }
     setlinebuf(log);
     // identify this as the log stream, set level, obtain remote handle
     fprintf(log, "%d\n%d\n", TCPREMOTE_LOG_STREAM, (int)level);
+    setLogState(LOG_REQUESTED);
     char ret[10];
     if (!fgets(ret, sizeof(ret), log)) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "fgets() log identifier: %s", strerror(errno));
@@ -124,14 +488,339 @@ int SoapyTCPRemote::connectLogStream(SoapySDRLogLevel level)
         SoapySDR_log(SOAPY_SDR_ERROR, "sscanf() logId: not an integer");
         return -1;
     }
-    logThread = std::thread(processLogStream, this);
     return 0;
 }
 
-void SoapyTCPRemote::processLogStream(SoapyTCPRemote *rem)
+void SoapyTCPRemote::setLogState(int state)
 {
+    std::lock_guard<std::mutex> lock(logMutex);
+    logState = state;
+    logCond.notify_all();
+}
+
+// wait until the log stream reaches state (or fails), returns the state reached
+int SoapyTCPRemote::waitLogState(int state)
+{
+    std::unique_lock<std::mutex> lock(logMutex);
+    logCond.wait(lock, [this, state]{ return logState>=state || LOG_FAILED==logState; });
+    return logState;
+}
+
+void SoapyTCPRemote::closeLogStream()
+{
+    if (!logThread.joinable())
+        return;
+    // writing to this stream terminates it via the remote end
+    if (waitLogState(LOG_READY)>=0)
+        write(fileno(log), "\n", 1);
+    logThread.join();
+}
+
+// measure link capacity: the remote sends as fast as it can for msecs, we time
+// from the first read (to exclude connection RTT) until it closes the stream.
+int SoapyTCPRemote::probeLink(int msecs)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::probeLink(%d)", msecs);
+    if (msecs<=0)
+        msecs = 1000;
+    int sock = connect();
+    if (sock<0)
+        return sock;
+    // round trip time before we fill the link (it would then include our own queueing), a fresh
+    // connection has the handshake's
+    struct tcp_info ti;
+    socklen_t tlen = sizeof(ti);
+    memset(&ti, 0, sizeof(ti));
+    getsockopt(mux? mux->socket(): sock, IPPROTO_TCP, TCP_INFO, &ti, &tlen);
+    char req[24];
+    int rlen = sprintf(req, "%d\n%d\n", TCPREMOTE_LINK_PROBE, msecs);
+    if (write(sock, req, rlen)!=rlen) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::probeLink, failed to write request: %s", strerror(errno));
+        close(sock);
+        return -1;
+    }
+    std::vector<uint8_t> buf(65536);
+    struct timespec t0, t1;
+    long long total = 0;
+    bool first = true;
+    ssize_t n;
+    // a stalled server gives up a connect timeout after the probe should have ended
+    long long deadline = monotonicMs()+msecs+connectTimeout;
+    while (true) {
+        long long left = deadline-monotonicMs();
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        int rv = left>0? poll(&pfd, 1, (int)left): 0;
+        if (rv<0 && EINTR==errno)
+            continue;
+        if (rv<=0) {
+            SoapySDR_log(SOAPY_SDR_ERROR, "SoapyTCPRemote::probeLink, timed out");
+            close(sock);
+            return -1;
+        }
+        if ((n=read(sock, buf.data(), buf.size()))<=0)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (first) {
+            t0 = t1;
+            first = false;
+        } else {
+            total += n;
+        }
+    }
+    close(sock);
+    double secs = first? 0: (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)/1e9;
+    if (secs<=0 || total<=0) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "SoapyTCPRemote::probeLink, no data received");
+        return -1;
+    }
+    linkRate = total/secs;
+    linkRtt = ti.tcpi_rtt;
+    SoapySDR_logf(SOAPY_SDR_INFO, "SoapyTCPRemote: link probe: %.1f Mbit/s, rtt %.1f msecs",
+        linkRate*8/1e6, linkRtt/1e3);
+    return 0;
+}
+
+// setter completion: wait for the status (throwing if it failed remotely, as the
+// device would locally), or in async mode let the next read collect it.
+void SoapyTCPRemote::complete(const char *what)
+{
+    if (async) {
+        rpc->deferStatus(what);
+        return;
+    }
+    int status = rpc->readInteger();
+    if (status<0)
+        throw std::runtime_error(std::string(what)+" failed on remote");
+}
+
+// fetch all static capabilities, older servers (or failures) leave us uncached
+int SoapyTCPRemote::describe()
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::describe()");
+    described = false;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_DESCRIBE);
+    int version = rpc->readInteger();
+    if (version!=TCPREMOTE_DESCRIBE_VERSION) {
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: describe unavailable (%d), not caching", version);
+        return -1;
+    }
+    capKey = rpc->readString();
+    capInfo = rpc->readKwargs();
+    for (int dir: {SOAPY_SDR_TX, SOAPY_SDR_RX}) {
+        int nchn = rpc->readInteger();
+        caps[dir].resize(nchn>0? nchn: 0);
+        for (auto &cc: caps[dir]) {
+            cc.info = rpc->readKwargs();
+            cc.fullDuplex = rpc->readInteger()>0;
+            cc.formats = rpc->readStrVector();
+            cc.nativeFormat = rpc->readString();
+            cc.fullScale = rpc->readDouble();
+            cc.gains = rpc->readStrVector();
+            cc.hasGainMode = rpc->readInteger()>0;
+            cc.gainRange = rpc->readRange();
+            cc.gainRanges.clear();
+            for (auto &nam: cc.gains)
+                cc.gainRanges[nam] = rpc->readRange();
+            cc.freqs = rpc->readStrVector();
+            cc.freqRange = rpc->readRangeList();
+            cc.freqRanges.clear();
+            for (auto &nam: cc.freqs)
+                cc.freqRanges[nam] = rpc->readRangeList();
+            cc.rateRange = rpc->readRangeList();
+            cc.hasFreqCorrection = rpc->readInteger()>0;
+        }
+    }
+    if (rpc->isError())
+        return -1;
+    described = true;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: cached capabilities, %d tx, %d rx channels",
+        (int)caps[SOAPY_SDR_TX].size(), (int)caps[SOAPY_SDR_RX].size());
+    return 0;
+}
+
+// cached capabilities of a channel, if we have them
+const SoapyTCPRemote::ChannelCaps *SoapyTCPRemote::cached(const int direction, const size_t channel) const
+{
+    if (!described || (direction!=SOAPY_SDR_TX && direction!=SOAPY_SDR_RX) || channel>=caps[direction].size())
+        return nullptr;
+    return &caps[direction][channel];
+}
+
+// per setting cache policy, space separated <setting>:off|read|write, setting may be 'all'
+int SoapyTCPRemote::parsePolicy(const std::string &spec)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::parsePolicy(%s)", spec.c_str());
+    // defaults: cache what we read back, and gain mode as written (it cannot be coerced)
+    dynPolicy["frequency"] = CACHE_READ;
+    dynPolicy["frequency_correction"] = CACHE_READ;
+    dynPolicy["gain"] = CACHE_READ;
+    dynPolicy["gain_mode"] = CACHE_WRITE;
+    dynPolicy["sample_rate"] = CACHE_READ;
+    dynPolicy["bandwidth"] = CACHE_READ;
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = spec.find(' ', cur);
+        std::string item = spec.substr(cur, nxt-cur);
+        size_t colon = item.find(':');
+        if (std::string::npos==colon)
+            continue;
+        std::string val = item.substr(colon+1);
+        int pol = "write"==val? CACHE_WRITE: "read"==val? CACHE_READ: CACHE_OFF;
+        std::string key = item.substr(0, colon);
+        if ("all"==key) {
+            for (auto &it: dynPolicy)
+                it.second = pol;
+        } else if (dynPolicy.find(key)!=dynPolicy.end()) {
+            dynPolicy[key] = pol;
+        } else {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "SoapyTCPRemote: unknown cache_policy setting: %s", key.c_str());
+        }
+    } while (nxt!=std::string::npos);
+    dynInvalidate("");
+    return 0;
+}
+
+// ask for change events on our log stream, which enables the dynamic settings cache
+int SoapyTCPRemote::subscribeEvents()
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::subscribeEvents()");
+    if (remoteLevel<1) {
+        SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote: change events unavailable (older remote), not caching settings");
+        dynEvents = false;
+        return -1;
+    }
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SUBSCRIBE_EVENTS);
+    rpc->writeInteger(logId);
+    int status = rpc->readInteger();
+    dynEvents = status>=0;
+    if (!dynEvents)
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote: change events unavailable (%d), not caching settings", status);
+    return status;
+}
+
+// the setting name in a cache key: "<dir> <chn> <setting>[ <name>]"
+static std::string keySetting(const std::string &key)
+{
+    size_t beg = key.find(' ', key.find(' ')+1)+1;
+    return key.substr(beg, key.find(' ', beg)-beg);
+}
+
+// what a change to key discards: it & any named under it, or for a sample rate the whole direction,
+// as channels usually share a rate, and bandwidths (among others) may follow it
+static std::string keyScope(const std::string &key)
+{
+    return "sample_rate"==keySetting(key)? key.substr(0, key.find(' ')): key;
+}
+
+// is key within a scope? Whole words only, so "gain" leaves "gain_mode"
+static bool inScope(const std::string &key, const std::string &scope)
+{
+    return 0==key.compare(0, scope.length(), scope)
+        && (scope.empty() || key.length()==scope.length() || ' '==key[scope.length()]);
+}
+
+int SoapyTCPRemote::keyPolicy(const std::string &key) const
+{
+    auto it = dynPolicy.find(keySetting(key));
+    return it!=dynPolicy.end()? it->second: CACHE_OFF;
+}
+
+bool SoapyTCPRemote::dynLookup(const int direction, const size_t channel, const std::string &key, double &val, unsigned &gen) const
+{
+    std::lock_guard<std::mutex> lock(dynMutex);
+    gen = dynGen;
+    if (!dynEvents || CACHE_OFF==keyPolicy(key))
+        return false;
+    for (auto &scope: dynHeld)
+        if (inScope(key, scope))
+            return false;
+    // gains move by themselves under automatic gain control, so need a known manual mode
+    if ("gain"==keySetting(key)) {
+        auto mode = dynCache.find(changeKey(direction, channel, "gain_mode"));
+        const ChannelCaps *cc = cached(direction, channel);
+        bool manual = mode!=dynCache.end()? mode->second==0: (cc && !cc->hasGainMode);
+        if (!manual)
+            return false;
+    }
+    auto it = dynCache.find(key);
+    if (it==dynCache.end())
+        return false;
+    val = it->second;
+    return true;
+}
+
+// store a value read (or written & confirmed), unless something changed since gen, or a timed
+// setter has yet to change it
+void SoapyTCPRemote::dynStore(const std::string &key, double val, unsigned gen, bool written) const
+{
+    std::lock_guard<std::mutex> lock(dynMutex);
+    int pol = keyPolicy(key);
+    if (!dynEvents || CACHE_OFF==pol)
+        return;
+    if (written && cmdTimed) {
+        dynHeld.insert(keyScope(key));
+        return;
+    }
+    if ((written && pol!=CACHE_WRITE) || gen!=dynGen)
+        return;
+    for (auto &scope: dynHeld)
+        if (inScope(key, scope))
+            return;
+    dynCache[key] = val;
+}
+
+// discard a cached key within keyScope() (all of a direction or channel, "" for everything),
+// returns the new generation
+unsigned SoapyTCPRemote::dynInvalidate(const std::string &key) const
+{
+    std::string prefix = keyScope(key);
+    std::lock_guard<std::mutex> lock(dynMutex);
+    auto it = dynCache.lower_bound(prefix);
+    while (it!=dynCache.end() && 0==it->first.compare(0, prefix.length(), prefix)) {
+        if (inScope(it->first, prefix))
+            it = dynCache.erase(it);
+        else
+            ++it;
+    }
+    return ++dynGen;
+}
+
+void SoapyTCPRemote::processLogStream(SoapyTCPRemote *rem, SoapySDRLogLevel level)
+{
+    if (rem->connectLogStream(level)<0) {
+        if (rem->log)
+            fclose(rem->log);
+        rem->log = nullptr;
+        rem->setLogState(LOG_FAILED);
+        return;
+    }
+    rem->setLogState(LOG_READY);
     char msg[256];
     while (fgets(msg, sizeof(msg), rem->log)) {
+        // change events for the settings cache
+        if ('E'==msg[0] && ':'==msg[1]) {
+            msg[strlen(msg)-1]=0;
+            rem->dynInvalidate(msg+2);
+            continue;
+        }
+        // pushed sensor values: "S:<dir> <chn> <key>=<value>"
+        if ('S'==msg[0] && ':'==msg[1]) {
+            msg[strlen(msg)-1]=0;
+            char *eq = strchr(msg, '=');
+            if (eq) {
+                *eq = 0;
+                std::lock_guard<std::mutex> lock(rem->sensorMutex);
+                SensorValue &sv = rem->sensorCache[msg+2];
+                sv.value = eq+1;
+                sv.at = monotonicMs();
+            }
+            continue;
+        }
         // parse level from message, write to local handler
         SoapySDRLogLevel lev = SOAPY_SDR_ERROR;
         if (sscanf(msg, "%d:", (int*)&lev)>0) {
@@ -152,6 +841,9 @@ void SoapyTCPRemote::processLogStream(SoapyTCPRemote *rem)
 std::string SoapyTCPRemote::getHardwareKey() const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getHardwareKey()");
+    if (described)
+        return capKey;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_HARDWARE_KEY);
     return rpc->readString();
@@ -160,25 +852,39 @@ std::string SoapyTCPRemote::getHardwareKey() const
 SoapySDR::Kwargs SoapyTCPRemote::getHardwareInfo() const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getHardwareInfo()");
-    rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_GET_HARDWARE_INFO);
-    return rpc->readKwargs();
+    SoapySDR::Kwargs info = capInfo;
+    if (!described) {
+        std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+        rpc->writeString(TCPREMOTE_RPC_SEP);
+        rpc->writeInteger(TCPREMOTE_GET_HARDWARE_INFO);
+        info = rpc->readKwargs();
+    }
+    if (linkRate>0) {
+        info["tcpremote:link_rate"] = std::to_string(linkRate);
+        info["tcpremote:link_rtt"] = std::to_string(linkRtt);
+    }
+    return info;
 }
 
 // Channels API
 void SoapyTCPRemote::setFrontendMapping(const int direction, const std::string &mapping)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrontendMapping()");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_FRONTEND_MAPPING);
     rpc->writeInteger(direction);
     rpc->writeString(mapping);
-    rpc->readInteger(); // wait for completion!
+    complete("setFrontendMapping");
+    // channel layout may have changed
+    if (described)
+        describe();
 }
 
 std::string SoapyTCPRemote::getFrontendMapping(const int direction) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrontendMapping()");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FRONTEND_MAPPING);
     rpc->writeInteger(direction);
@@ -188,6 +894,9 @@ std::string SoapyTCPRemote::getFrontendMapping(const int direction) const
 size_t SoapyTCPRemote::getNumChannels(const int dir) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getNumChannels()");
+    if (described && (SOAPY_SDR_TX==dir || SOAPY_SDR_RX==dir))
+        return caps[dir].size();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_NUM_CHANNELS);
     rpc->writeInteger(dir);
@@ -197,6 +906,10 @@ size_t SoapyTCPRemote::getNumChannels(const int dir) const
 SoapySDR::Kwargs SoapyTCPRemote::getChannelInfo(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getChannelInfo()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->info;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_CHANNEL_INFO);
     rpc->writeInteger(direction);
@@ -207,6 +920,10 @@ SoapySDR::Kwargs SoapyTCPRemote::getChannelInfo(const int direction, const size_
 bool SoapyTCPRemote::getFullDuplex(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFullDuplex()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->fullDuplex;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FULL_DUPLEX);
     rpc->writeInteger(direction);
@@ -217,6 +934,10 @@ bool SoapyTCPRemote::getFullDuplex(const int direction, const size_t channel) co
 std::vector<std::string> SoapyTCPRemote::getStreamFormats(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getStreamFormats()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->formats;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_STREAM_FORMATS);
     rpc->writeInteger(direction);
@@ -227,6 +948,12 @@ std::vector<std::string> SoapyTCPRemote::getStreamFormats(const int direction, c
 std::string SoapyTCPRemote::getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getNativeStreamFormat()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc) {
+        fullScale = cc->fullScale;
+        return cc->nativeFormat;
+    }
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_STREAM_NATIVE_FORMAT);
     rpc->writeInteger(direction);
@@ -239,6 +966,7 @@ std::string SoapyTCPRemote::getNativeStreamFormat(const int direction, const siz
 SoapySDR::ArgInfoList SoapyTCPRemote::getStreamArgsInfo(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getStreamArgsInfo()");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_STREAM_ARGS_INFO);
     rpc->writeInteger(direction);
@@ -254,6 +982,37 @@ SoapySDR::ArgInfoList SoapyTCPRemote::getStreamArgsInfo(const int direction, con
     return info;
 }
 
+// connect a data stream, which the remote identifies by remoteId
+int SoapyTCPRemote::connectData(const int direction, int &remoteId)
+{
+    int data = connect();
+    if (data<0) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, data stream failed to connect");
+        return -1;
+    }
+    // sending one of TCPREMOTE_DATA_<x> makes this a data stream in the remote,
+    // received in blocks if the remote has them
+    char dir[10];
+    int dlen = sprintf(dir, "%d\n", SOAPY_SDR_RX!=direction? TCPREMOTE_DATA_RECV :
+        remoteLevel>0? TCPREMOTE_DATA_SEND_BLOCKS : TCPREMOTE_DATA_SEND);
+    if (write(data, dir, dlen)!=dlen) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, failed to write data stream type: %s",
+            strerror(errno));
+        close(data);
+        return -1;
+    }
+    dlen = read(data, dir, sizeof(dir)-1);
+    if (dlen<=0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, failed to read data stream remoteId: %s",
+            strerror(errno));
+        close(data);
+        return -1;
+    }
+    dir[dlen]=0;
+    sscanf(dir, "%d", &remoteId);
+    return data;
+}
+
 SoapySDR::Stream *SoapyTCPRemote::setupStream(const int direction, const std::string &format, const std::vector<size_t> &channels, const SoapySDR::Kwargs &args)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setupStream(%d,%s,%d,...)",
@@ -265,6 +1024,16 @@ SoapySDR::Stream *SoapyTCPRemote::setupStream(const int direction, const std::st
     } else {
         lchannels.insert(lchannels.begin(), channels.begin(), channels.end());
     }
+    // hop schedules need a remote that sends dwell markers, and retune behind our back
+    if (args.find("tcpremote:hops")!=args.end()) {
+        if (remoteLevel<2) {
+            SoapySDR_log(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, remote does not support tcpremote:hops");
+            return nullptr;
+        }
+        dynPolicy["frequency"] = CACHE_OFF;
+        for (auto chn: lchannels)
+            dynInvalidate(changeKey(direction, chn, "frequency"));
+    }
     // grab the native format
     double fs;
     std::string fmtnat = getNativeStreamFormat(direction, lchannels[0], fs);
@@ -278,45 +1047,68 @@ SoapySDR::Stream *SoapyTCPRemote::setupStream(const int direction, const std::st
         return nullptr;
     }
     // choose smallest wire format..
-    if (g_frameSizes.at(fmtnat)<g_frameSizes.at(format)) {
+    std::string fmtwire = format;
+    if (g_frameSizes.at(fmtnat)<g_frameSizes.at(format))
         fmtwire = fmtnat;
-        fmtout = format;
-    } else {
-        fmtwire = format;
-        fmtout = format;
+    // receive buffers: huge pages, locked, on the NUMA node we are set up on (the remote uses it too)
+    int bufFlags = 0;
+    bool bufConfigured = args.find("tcpremote:buffers")!=args.end();
+    if (bufConfigured && !parseBufferFlags(args.at("tcpremote:buffers"), bufFlags)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, invalid tcpremote:buffers (%s)", args.at("tcpremote:buffers").c_str());
+        return nullptr;
     }
+    // optionally striped across several data connections (pointless within a session)
+    int stripes = 1;
+    if (args.find("tcpremote:stripes")!=args.end())
+        stripes = atoi(args.at("tcpremote:stripes").c_str());
+    if (stripes>1 && (SOAPY_SDR_RX!=direction || remoteLevel<7 || mux)) {
+        SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote::setupStream, tcpremote:stripes not supported here, using one connection");
+        stripes = 1;
+    }
+    if (stripes>TCPREMOTE_MAX_STRIPES)
+        stripes = TCPREMOTE_MAX_STRIPES;
     // in order to help the remote side associate the data stream with the setup call,
     // we create the data connection *first*, then send it's remoteId as the first
     // parameter to the RPC call..
-    int data = connect();
-    if (data<0) {
-        SoapySDR_log(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, data stream failed to connect");
-        return nullptr;
-    }
-    // sending one of TCPREMOTE_DATA_<x> makes this a data stream in the remote
-    char dir[10];
-    int dlen = sprintf(dir, "%d\n", SOAPY_SDR_RX==direction? TCPREMOTE_DATA_SEND : TCPREMOTE_DATA_RECV);
-    if (write(data, dir, dlen)!=dlen) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, failed to write data stream type: %s",
-            strerror(errno));
-        close(data);
-        return nullptr;
-    }
-    dlen = read(data, dir, sizeof(dir));
-    if (dlen<=0) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, failed to read data stream remoteId: %s",
-            strerror(errno));
-        close(data);
+    int remoteId;
+    int data = connectData(direction, remoteId);
+    if (data<0)
         return nullptr;
-    }
     SoapySDR::Stream *rv = new SoapySDR::Stream();
-    dir[dlen]=0;
-    sscanf(dir, "%d", &rv->remoteId);
+    rv->remoteId = remoteId;
     rv->netSock = data;
+    rv->stripes.push_back({ data, false, {}, 0, 0 });
+    rv->statAt = monotonicMs();
+    rv->cur = 0;
+    rv->nextSeq = 0;
+    // any more stripes are passed by remoteId too, we carry on with fewer if they fail
+    SoapySDR::Kwargs sargs = args;
+    std::string ids;
+    for (int n=1; n<stripes; ++n) {
+        int sock = connectData(direction, remoteId);
+        if (sock<0)
+            break;
+        rv->stripes.push_back({ sock, false, {}, 0, 0 });
+        ids += (ids.length()>0? " ": "")+std::to_string(remoteId);
+    }
+    if (ids.length()>0)
+        sargs["tcpremote:stripe_ids"] = ids;
     rv->fSize = g_frameSizes.at(fmtwire);
     rv->numChans = lchannels.size();
     rv->running = false;
+    rv->actAt = 0;
+    rv->burst = false;
+    rv->fmtOut = format;
+    rv->fmtWire = fmtwire;
+    rv->framed = remoteLevel>0;
+    rv->left = 0;
+    rv->repeat = 0;
+    int cpu = sched_getcpu();
+    SoapySDRLogLevel bufLevel = bufConfigured? SOAPY_SDR_WARNING: SOAPY_SDR_DEBUG;
+    rv->rxBuf.setup(bufFlags, cpu<0? -1: cpuNode(cpu), "SoapyTCPRemote::setupStream, receive buffer", bufLevel);
+    rv->cvBuf.setup(bufFlags, cpu<0? -1: cpuNode(cpu), "SoapyTCPRemote::setupStream, conversion buffer", bufLevel);
     // make the RPC call with the remoteId
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SETUP_STREAM);
     rpc->writeInteger(rv->remoteId);
@@ -330,10 +1122,22 @@ SoapySDR::Stream *SoapyTCPRemote::setupStream(const int direction, const std::st
         chans += std::to_string(*it);
     }
     rpc->writeString(chans);
-    rpc->writeKwargs(args);
+    rpc->writeKwargs(sargs);
     int status = rpc->readInteger();
     if (status>=0) {
         SoapySDR_logf(SOAPY_SDR_TRACE,"SoapyTCPRemote::setupStream, data stream remoteId: %d", rv->remoteId);
+        // prefault a (remote) MTU's worth, if asked
+        if (bufConfigured && SOAPY_SDR_RX==direction) {
+            int mtu = getStreamMTU(rv);
+            if (mtu>0) {
+                rv->rxBuf.ensure(mtu*rv->fSize*rv->numChans);
+                if (format!=fmtwire)
+                    rv->cvBuf.ensure(mtu*g_frameSizes.at(format)*rv->numChans);
+                SoapySDR_logf(SOAPY_SDR_DEBUG, "SoapyTCPRemote::setupStream, receive buffer: %s", rv->rxBuf.info().c_str());
+            }
+        }
+        std::lock_guard<std::mutex> lock(statsMutex);
+        streams.insert(rv);
     } else {
         SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::setupStream, error: %d", status);
         if (rv)
@@ -348,17 +1152,24 @@ void SoapyTCPRemote::closeStream(SoapySDR::Stream *stream)
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::closeStream()");
     if (stream->running)
         deactivateStream(stream);
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_CLOSE_STREAM);
     rpc->writeInteger(stream->remoteId);
     rpc->readInteger(); // ignore return value, but wait!
-    close(stream->netSock);
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        streams.erase(stream);
+    }
+    for (auto &st: stream->stripes)
+        close(st.sock);
     delete stream;
 }
 
 size_t SoapyTCPRemote::getStreamMTU(SoapySDR::Stream *stream) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getStreamMTU()");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_STREAM_MTU);
     rpc->writeInteger(stream->remoteId);
@@ -370,15 +1181,35 @@ int SoapyTCPRemote::activateStream(SoapySDR::Stream *stream,
                                const long long timeNs,
                                const size_t numElems)
 {
-    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::activateStream()");
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::activateStream(%d,%lld,%d)", flags, timeNs, (int)numElems);
     if (stream->running)
         return 0;
+    // timed and/or finite burst, the remote stops after numElems & flags the end
+    bool timed = flags || timeNs || numElems;
+    if (timed && remoteLevel<5)
+        return SOAPY_SDR_NOT_SUPPORTED;
+    long long start = monotonicUs();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
-    rpc->writeInteger(TCPREMOTE_ACTIVATE_STREAM);
-    rpc->writeInteger(stream->remoteId);
+    if (timed) {
+        rpc->writeInteger(TCPREMOTE_ACTIVATE_STREAM_AT);
+        rpc->writeInteger(stream->remoteId);
+        rpc->writeInteger(flags);
+        rpc->writeLong(timeNs);
+        rpc->writeLong(numElems);
+    } else {
+        rpc->writeInteger(TCPREMOTE_ACTIVATE_STREAM);
+        rpc->writeInteger(stream->remoteId);
+    }
     int status = rpc->readInteger();
-    if (status==0)
+    if (status==0) {
         stream->running = true;
+        stream->burst = numElems>0;
+        stream->actAt = start;
+        std::lock_guard<std::mutex> lock(statsMutex);
+        activateUs = monotonicUs()-start;
+        firstSampleUs = -1;
+    }
     return status;
 }
 
@@ -387,6 +1218,7 @@ int SoapyTCPRemote::deactivateStream(SoapySDR::Stream *stream, const int flags,
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::deactivateStream()");
     if (!stream->running)
         return 0;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_DEACTIVATE_STREAM);
     rpc->writeInteger(stream->remoteId);
@@ -396,16 +1228,134 @@ int SoapyTCPRemote::deactivateStream(SoapySDR::Stream *stream, const int flags,
     return status;
 }
 
-static void *convertCS16toCF32(void *dst, const void *src, size_t cnt /* ignored */)
+// wait until a socket has want bytes to read, or the deadline (monotonicMs()) passes: returns
+// the bytes it has, 0 if they did not all arrive in time (left unread), -1 on error or EOF
+static int awaitBytes(int sock, size_t want, long long deadline)
+{
+    while (true) {
+        int avail = 0;
+        if (ioctl(sock, FIONREAD, &avail)<0)
+            return -1;
+        if ((size_t)avail>=want)
+            return avail;
+        long long wait = deadline-monotonicMs();
+        // some has arrived, so poll would not wait for the rest: look now, then again shortly
+        struct pollfd pfd = { sock, POLLIN | POLLRDHUP, 0 };
+        int status = poll(&pfd, 1, avail>0 || wait<=0? 0: (int)wait);
+        if (status<0 && EINTR!=errno)
+            return -1;
+        if (status>0 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR)))
+            return ioctl(sock, FIONREAD, &avail)<0 || (size_t)avail<want? -1: avail;
+        if (wait<=0)
+            return 0;
+        if (avail>0)
+            usleep(1000);
+    }
+}
+
+// read exactly len bytes from a socket (blocking, so only those known to have arrived)
+static int readFully(int sock, void *buf, size_t len)
+{
+    size_t got = 0;
+    while (got<len) {
+        ssize_t n = recv(sock, (uint8_t *)buf+got, len-got, MSG_WAITALL);
+        if (n<0 && EINTR==errno)
+            continue;
+        if (n<=0)
+            return -1;
+        got += n;
+    }
+    return (int)got;
+}
+
+// the samples of a block have all been read: flag the end of a burst (or dwell)
+static void endBlock(SoapySDR::Stream *stream, int &flags)
 {
-    int16_t *cs16 = (int16_t *)src;
-    float *cf32   = (float *)dst;
-    // convert complex sample in range -INT16_MAX>INT16_MAX to -1.0>1.0
-    int16_t si = cs16[0];
-    int16_t sq = cs16[1];
-    cf32[0]   = (float)si/(float)INT16_MAX;
-    cf32[1] = (float)sq/(float)INT16_MAX;
-    return dst;
+    flags |= stream->block.flags & SOAPY_SDR_END_BURST;
+    // the remote stops at the end of a burst, another activation starts the next
+    if ((flags & SOAPY_SDR_END_BURST) && stream->burst)
+        stream->running = false;
+}
+
+// the next block header of a stream, in sequence: from its data connection, or for striped
+// streams whichever has it at its head, reading ahead headers on the others until it does
+int SoapyTCPRemote::nextBlock(SoapySDR::Stream *stream, const long timeoutUs)
+{
+    // the original unframed stream: whatever has arrived (in whole elements) is a block
+    if (!stream->framed) {
+        struct pollfd pfd = { stream->netSock, POLLIN, 0 };
+        int status = poll(&pfd, 1, timeoutUs/1000);
+        if (0==status)
+            return SOAPY_SDR_TIMEOUT;
+        int avail = 0;
+        if (status<0 || ioctl(stream->netSock, FIONREAD, &avail)<0 || avail<=0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading data: %s", status<0 || avail<0? strerror(errno): "EOF");
+            return SOAPY_SDR_STREAM_ERROR;
+        }
+        size_t elemSize = stream->fSize*stream->numChans;
+        memset(&stream->block, 0, sizeof(stream->block));
+        stream->block.magic = TCPREMOTE_BLOCK_MAGIC;
+        stream->block.format = formatCode(stream->fmtWire);
+        stream->block.decim = 1;
+        stream->block.length = (size_t)avail>elemSize? avail/elemSize*elemSize: elemSize;
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stream->stripes[0].bytes += stream->block.length;
+        return 0;
+    }
+    size_t num = stream->stripes.size();
+    long long deadline = monotonicMs()+timeoutUs/1000;
+    while (true) {
+        // the next in sequence, or the lowest once all have one (the next was dropped)
+        size_t pick = num, lowest = num, waiting = 0;
+        for (size_t idx=0; idx<num && pick==num; ++idx) {
+            SoapySDR::Stream::Stripe &st = stream->stripes[idx];
+            if (!st.ahead)
+                ++waiting;
+            else if (st.block.seq==stream->nextSeq)
+                pick = idx;
+            else if (lowest==num || (int32_t)(st.block.seq-stream->stripes[lowest].block.seq)<0)
+                lowest = idx;
+        }
+        if (pick==num && 0==waiting)
+            pick = lowest;
+        if (pick<num) {
+            SoapySDR::Stream::Stripe &st = stream->stripes[pick];
+            st.ahead = false;
+            stream->block = st.block;
+            stream->cur = pick;
+            stream->nextSeq = st.block.seq+1;
+            std::lock_guard<std::mutex> lock(statsMutex);
+            st.bytes += sizeof(st.block)+st.block.length;
+            return 0;
+        }
+        struct pollfd pfds[num];
+        size_t idxs[num], nfds = 0;
+        for (size_t idx=0; idx<num; ++idx) {
+            if (!stream->stripes[idx].ahead) {
+                pfds[nfds] = { stream->stripes[idx].sock, POLLIN, 0 };
+                idxs[nfds++] = idx;
+            }
+        }
+        long long wait = deadline-monotonicMs();
+        int status = poll(pfds, nfds, wait>0? wait: 0);
+        if (0==status)
+            return SOAPY_SDR_TIMEOUT;
+        for (size_t idx=0; idx<nfds && status>0; ++idx) {
+            if (!pfds[idx].revents)
+                continue;
+            SoapySDR::Stream::Stripe &st = stream->stripes[idxs[idx]];
+            int avail = awaitBytes(st.sock, sizeof(st.block), deadline);
+            if (0==avail)
+                return SOAPY_SDR_TIMEOUT;
+            if (avail<0 || readFully(st.sock, &st.block, sizeof(st.block))<0)
+                status = -1;
+            st.ahead = true;
+        }
+        if (status<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading block header: %s", strerror(errno));
+            return SOAPY_SDR_STREAM_ERROR;
+        }
+    }
 }
 
 int SoapyTCPRemote::readStream(SoapySDR::Stream *stream,
@@ -419,39 +1369,167 @@ int SoapyTCPRemote::readStream(SoapySDR::Stream *stream,
     // Not running? timeout (says the docs)
     if (!stream->running)
         return SOAPY_SDR_TIMEOUT;
-    // Transfer format on the wire is interleaved sample frames (each fSize) across channels.
-    // We read by making one syscall for the maximum amount, then de-interleaving and possibly
-    // converting formats into buffs.
-    size_t blkSize = stream->fSize * stream->numChans;
-    uint8_t *swamp = (uint8_t *)alloca(blkSize * numElems);
-    int status = read(stream->netSock, swamp, blkSize*numElems);
-    if (status<=0) {
+    // Transfer format on the wire is a sequence of blocks, each a header followed by
+    // interleaved sample frames across channels. The header gives the wire format
+    // and decimation for that block, which may change as the remote adapts to the
+    // network, so we convert (and repeat samples to undo decimation) per block.
+    // Hop schedules also send a dwell marker block ahead of each dwell's samples, which
+    // we note and skip, and flag the end of each dwell's samples with END_BURST.
+    // A decimated sample's repeats that did not fit last time come first.
+    if (stream->repeat>0) {
+        size_t bSize = formatSize(formatCode(stream->fmtOut));
+        size_t elems = 0;
+        for (; elems<numElems && elems<stream->repeat; ++elems) {
+            for (int c=0; c<stream->numChans; ++c)
+                memcpy((uint8_t *)(buffs[c])+elems*bSize, stream->held.data()+c*bSize, bSize);
+        }
+        stream->repeat -= elems;
+        flags = 0;
+        timeNs = 0;
+        if (0==stream->repeat && 0==stream->left)
+            endBlock(stream, flags);
+        return (int)elems;
+    }
+    // the whole read keeps to timeoutUs, a block (or dwell marker) not yet all here is left
+    // for the next read, as far as we got (stream->left)
+    long long deadline = monotonicMs()+timeoutUs/1000;
+    int sock = stream->stripes[stream->cur].sock;
+    while (0==stream->left || (stream->block.flags & TCPREMOTE_BLOCK_DWELL)) {
+        if (0==stream->left) {
+            long long wait = deadline-monotonicMs();
+            int status = nextBlock(stream, wait>0? wait*1000: 0);
+            if (status<0)
+                return status;
+            sock = stream->stripes[stream->cur].sock;
+            if (stream->block.magic!=TCPREMOTE_BLOCK_MAGIC || 0==formatSize(stream->block.format) || 0==stream->block.decim) {
+                SoapySDR_log(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, invalid block header (out of sync?)");
+                return SOAPY_SDR_CORRUPTION;
+            }
+            stream->left = stream->block.length;
+            if ((stream->block.flags & TCPREMOTE_BLOCK_DWELL) && stream->left!=sizeof(TCPRemoteDwell)) {
+                SoapySDR_log(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, invalid dwell marker (out of sync?)");
+                return SOAPY_SDR_CORRUPTION;
+            }
+            // an empty block may still end a burst
+            if (0==stream->left && (stream->block.flags & SOAPY_SDR_END_BURST)) {
+                flags = SOAPY_SDR_END_BURST;
+                timeNs = 0;
+                if (stream->burst)
+                    stream->running = false;
+                return 0;
+            }
+        }
+        if (stream->block.flags & TCPREMOTE_BLOCK_DWELL) {
+            TCPRemoteDwell dwell;
+            int avail = awaitBytes(sock, sizeof(dwell), deadline);
+            if (0==avail)
+                return SOAPY_SDR_TIMEOUT;
+            if (avail<0 || readFully(sock, &dwell, sizeof(dwell))<0) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading dwell marker: %s", strerror(errno));
+                return SOAPY_SDR_STREAM_ERROR;
+            }
+            stream->left = 0;
+            char info[64];
+            if (TCPREMOTE_DWELL_DONE==dwell.index)
+                info[0] = 0;
+            else
+                snprintf(info, sizeof(info), "%u %u %.17g", dwell.index, dwell.pass, dwell.frequency);
+            dwellInfo = info;
+        }
+    }
+    flags = 0;
+    timeNs = 0;
+    // a block's time is that of its first sample, so only reads from its start have one
+    bool first = stream->left==stream->block.length;
+    // read as many whole elements of this block as will fit in buffs after expansion
+    int wfmt = stream->block.format;
+    size_t decim = stream->block.decim;
+    size_t wSize = formatSize(wfmt) * stream->numChans;
+    size_t nIn = numElems/decim;
+    if (nIn<1)
+        nIn = 1;
+    if (nIn>stream->left/wSize)
+        nIn = stream->left/wSize;
+    // only whole elements, & as many as have arrived
+    int avail = awaitBytes(sock, nIn>0? wSize: stream->left, deadline);
+    if (0==avail)
+        return SOAPY_SDR_TIMEOUT;
+    if (avail<0) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading data: %s", strerror(errno));
         return SOAPY_SDR_STREAM_ERROR;
     }
-    status /= stream->fSize;
-    int elems=0;
-    int soff=0;
-    int boff=0;
-    int bSize=stream->fSize;
-    void *(*cnv)(void *, const void *, size_t) = memcpy;
-    if (fmtout!=fmtwire) {
-        bSize = g_frameSizes.at(fmtout);
-        // TODO: actually check these formats =)
-        cnv = convertCS16toCF32;
-    }
-    while (elems<status) {
-        for (int c=0; c<stream->numChans; ++c) {
-            uint8_t *buf = (uint8_t *)(buffs[c]);
-            cnv(buf+boff, swamp+soff, stream->fSize);
-            soff += stream->fSize;
+    if (0==nIn) {
+        // nothing useful in this block (should not happen), skip it
+        void *skip = stream->rxBuf.ensure(stream->left);
+        if (!skip || readFully(sock, skip, stream->left)<0)
+            return SOAPY_SDR_STREAM_ERROR;
+        stream->left = 0;
+        return SOAPY_SDR_TIMEOUT;
+    }
+    if (nIn>(size_t)avail/wSize)
+        nIn = avail/wSize;
+    uint8_t *rx = (uint8_t *)stream->rxBuf.ensure(nIn*wSize);
+    if (!rx)
+        return SOAPY_SDR_STREAM_ERROR;
+    if (readFully(sock, rx, nIn*wSize)<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::readStream, error reading data: %s", strerror(errno));
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    stream->left -= nIn*wSize;
+    if (stream->actAt>0) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        firstSampleUs = monotonicUs()-stream->actAt;
+        stream->actAt = 0;
+    }
+    if (first && (stream->block.flags & SOAPY_SDR_HAS_TIME)) {
+        flags |= SOAPY_SDR_HAS_TIME;
+        timeNs = stream->block.timeNs;
+        // stamped by the server's clock? then we know when (on ours) & how long ago
+        long long now = realtimeNs();
+        double offset;
+        if ((stream->block.flags & TCPREMOTE_BLOCK_HOSTTIME) && clockEstimate(now, offset)) {
+            long long local = timeNs-(long long)offset;
+            std::lock_guard<std::mutex> lock(clockMutex);
+            latencyNs = now-local;
+            latencyValid = true;
+            if (clockLocal)
+                timeNs = local;
         }
-        boff += bSize;
-        ++elems;
     }
-    return elems;
+    // convert to requested format if required
+    int ofmt = formatCode(stream->fmtOut);
+    size_t bSize = formatSize(ofmt);
+    const uint8_t *src = rx;
+    if (ofmt!=wfmt) {
+        uint8_t *cv = (uint8_t *)stream->cvBuf.ensure(nIn*bSize*stream->numChans);
+        if (!cv)
+            return SOAPY_SDR_STREAM_ERROR;
+        convertSamples(cv, ofmt, src, wfmt, nIn, stream->numChans);
+        src = cv;
+    }
+    // de-interleave into channel buffers, repeating each sample to undo decimation,
+    // holding the last if buffs are too short for all its repeats (fewer than decim)
+    size_t elems = 0;
+    for (size_t idx=0; idx<nIn; ++idx) {
+        size_t rep = 0;
+        for (; rep<decim && elems<numElems; ++rep) {
+            for (int c=0; c<stream->numChans; ++c) {
+                uint8_t *buf = (uint8_t *)(buffs[c]);
+                memcpy(buf+elems*bSize, src+(idx*stream->numChans+c)*bSize, bSize);
+            }
+            ++elems;
+        }
+        if (rep<decim) {
+            stream->held.assign(src+idx*stream->numChans*bSize, src+(idx+1)*stream->numChans*bSize);
+            stream->repeat = decim-rep;
+        }
+    }
+    if (0==stream->repeat && 0==stream->left)
+        endBlock(stream, flags);
+    return (int)elems;
 }
 
+
 int SoapyTCPRemote::writeStream(SoapySDR::Stream *stream,
                     const void * const *buffs,
                     const size_t numElems,
@@ -501,6 +1579,10 @@ int SoapyTCPRemote::readStreamStatus(
 bool SoapyTCPRemote::hasFrequencyCorrection(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::hasFrequencyCorrection()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->hasFreqCorrection;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_HAS_FREQUENCY_CORRECTION);
     rpc->writeInteger(direction);
@@ -511,22 +1593,33 @@ bool SoapyTCPRemote::hasFrequencyCorrection(const int direction, const size_t ch
 void SoapyTCPRemote::setFrequencyCorrection(const int direction, const size_t channel, double value)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrequencyCorrection()");
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "frequency_correction"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_FREQUENCY_CORRECTION);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(value);
-    rpc->readInteger(); // wait for completion!
+    complete("setFrequencyCorrection");
+    dynStore(changeKey(direction, channel, "frequency_correction"), value, gen, true);
 }
 
 double SoapyTCPRemote::getFrequencyCorrection(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyCorrection()");
+    std::string key = changeKey(direction, channel, "frequency_correction");
+    double val;
+    unsigned gen;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_CORRECTION);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    return rpc->readDouble();
+    val = rpc->readDouble();
+    dynStore(key, val, gen, false);
+    return val;
 }
 
 std::vector<std::string> SoapyTCPRemote::listGains(const int direction, const size_t channel) const
@@ -534,6 +1627,10 @@ std::vector<std::string> SoapyTCPRemote::listGains(const int direction, const si
     //list available gain element names,
     //the functions below have a "name" parameter
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listGains()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->gains;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_LIST_GAINS);
     rpc->writeInteger(direction);
@@ -544,6 +1641,10 @@ std::vector<std::string> SoapyTCPRemote::listGains(const int direction, const si
 bool SoapyTCPRemote::hasGainMode(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::hasGainMode()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->hasGainMode;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_HAS_GAIN_MODE);
     rpc->writeInteger(direction);
@@ -554,95 +1655,128 @@ bool SoapyTCPRemote::hasGainMode(const int direction, const size_t channel) cons
 void SoapyTCPRemote::setGainMode(const int direction, const size_t channel, const bool automatic)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setGainMode()");
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "gain_mode"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_GAIN_MODE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeInteger(automatic?1:0);
-    rpc->readInteger(); // wait for completion!
+    complete("setGainMode");
+    dynStore(changeKey(direction, channel, "gain_mode"), automatic?1:0, gen, true);
 }
 
 bool SoapyTCPRemote::getGainMode(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGainMode()");
+    std::string key = changeKey(direction, channel, "gain_mode");
+    double val;
+    unsigned gen;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val>0;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_GAIN_MODE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    return rpc->readInteger()>0;
+    val = rpc->readInteger();
+    dynStore(key, val, gen, false);
+    return val>0;
 }
 
 void SoapyTCPRemote::setGain(const int direction, const size_t channel, const double value)
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::setGain()");
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "gain"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_GAIN);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(value);
-    rpc->readInteger(); // wait for completion!
+    complete("setGain");
+    dynStore(changeKey(direction, channel, "gain"), value, gen, true);
 }
 
 void SoapyTCPRemote::setGain(const int direction, const size_t channel, const std::string &name, const double value)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setGain(%s)", name.c_str());
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "gain"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_GAIN_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
     rpc->writeDouble(value);
-    rpc->readInteger(); // wait for completion!
+    complete("setGain");
+    dynStore(changeKey(direction, channel, "gain") + " " + name, value, gen, true);
 }
 
 double SoapyTCPRemote::getGain(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGain()");
+    std::string key = changeKey(direction, channel, "gain");
+    double val;
+    unsigned gen;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_GAIN);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    return rpc->readDouble();
+    val = rpc->readDouble();
+    dynStore(key, val, gen, false);
+    return val;
 }
 
 double SoapyTCPRemote::getGain(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGain(%s)", name.c_str());
+    std::string key = changeKey(direction, channel, "gain") + " " + name;
+    double val;
+    unsigned gen;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_GAIN_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
-    return rpc->readDouble();
+    val = rpc->readDouble();
+    dynStore(key, val, gen, false);
+    return val;
 }
 
 SoapySDR::Range SoapyTCPRemote::getGainRange(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGainRange()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->gainRange;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_GAIN_RANGE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    return SoapySDR::Range(
-        rpc->readDouble(),
-        rpc->readDouble(),
-        rpc->readDouble()
-    );
+    return rpc->readRange();
 }
 
 SoapySDR::Range SoapyTCPRemote::getGainRange(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getGainRange(%s)", name.c_str());
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc && cc->gainRanges.find(name)!=cc->gainRanges.end())
+        return cc->gainRanges.at(name);
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_GAIN_RANGE_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
-    return SoapySDR::Range(
-        rpc->readDouble(),
-        rpc->readDouble(),
-        rpc->readDouble()
-    );
+    return rpc->readRange();
 }
 
 // Frequency
@@ -652,13 +1786,16 @@ void SoapyTCPRemote::setFrequency(const int direction,
                               const SoapySDR::Kwargs &args)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrequency(%f)", frequency);
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "frequency"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_FREQUENCY);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(frequency);
     rpc->writeKwargs(args);
-    rpc->readInteger(); // wait for completion!
+    complete("setFrequency");
+    dynStore(changeKey(direction, channel, "frequency"), frequency, gen, true);
 }
 
 void SoapyTCPRemote::setFrequency(const int direction,
@@ -668,6 +1805,8 @@ void SoapyTCPRemote::setFrequency(const int direction,
                               const SoapySDR::Kwargs &args)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setFrequency(%s,%f)", name.c_str(), frequency);
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "frequency"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_FREQUENCY_NAMED);
     rpc->writeInteger(direction);
@@ -675,33 +1814,54 @@ void SoapyTCPRemote::setFrequency(const int direction,
     rpc->writeString(name);
     rpc->writeDouble(frequency);
     rpc->writeKwargs(args);
-    rpc->readInteger(); // wait for completion!
+    complete("setFrequency");
+    dynStore(changeKey(direction, channel, "frequency") + " " + name, frequency, gen, true);
 }
 
 double SoapyTCPRemote::getFrequency(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequency()");
+    std::string key = changeKey(direction, channel, "frequency");
+    double val;
+    unsigned gen;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FREQUENCY);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    return rpc->readDouble();
+    val = rpc->readDouble();
+    dynStore(key, val, gen, false);
+    return val;
 }
 
 double SoapyTCPRemote::getFrequency(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequency(%s)", name.c_str());
+    std::string key = changeKey(direction, channel, "frequency") + " " + name;
+    double val;
+    unsigned gen;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
-    return rpc->readDouble();
+    val = rpc->readDouble();
+    dynStore(key, val, gen, false);
+    return val;
 }
 
 std::vector<std::string> SoapyTCPRemote::listFrequencies(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listFrequencies()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->freqs;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_LIST_FREQUENCIES);
     rpc->writeInteger(direction);
@@ -711,48 +1871,37 @@ std::vector<std::string> SoapyTCPRemote::listFrequencies(const int direction, co
 SoapySDR::RangeList SoapyTCPRemote::getFrequencyRange(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyRange()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->freqRange;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_RANGE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    // read triplets of beg/end/step until step<0
-    SoapySDR::RangeList list;
-    while (true) {
-        double beg = rpc->readDouble();
-        double end = rpc->readDouble();
-        double step = rpc->readDouble();
-        if (step<0)
-            break;
-        list.push_back(SoapySDR::Range(beg,end,step));
-    }
-    return list;
+    return rpc->readRangeList();
 }
 
 
 SoapySDR::RangeList SoapyTCPRemote::getFrequencyRange(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyRange(%s)", name.c_str());
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc && cc->freqRanges.find(name)!=cc->freqRanges.end())
+        return cc->freqRanges.at(name);
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_RANGE_NAMED);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeString(name);
-    // read triplets of beg/end/step until step<0
-    SoapySDR::RangeList list;
-    while (true) {
-        double beg = rpc->readDouble();
-        double end = rpc->readDouble();
-        double step = rpc->readDouble();
-        if (step<0)
-            break;
-        list.push_back(SoapySDR::Range(beg,end,step));
-    }
-    return list;
+    return rpc->readRangeList();
 }
 
 SoapySDR::ArgInfoList SoapyTCPRemote::getFrequencyArgsInfo(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getFrequencyArgsInfo()");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_FREQUENCY_ARGS_INFO);
     rpc->writeInteger(direction);
@@ -772,22 +1921,46 @@ SoapySDR::ArgInfoList SoapyTCPRemote::getFrequencyArgsInfo(const int direction,
 void SoapyTCPRemote::setSampleRate(const int direction, const size_t channel, const double rate)
 {
     SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setSampleRate(%f)", rate);
+    // check against probed link capacity, assuming native format on the wire
+    if (linkRate>0) {
+        double fs;
+        std::string fmt = getNativeStreamFormat(direction, channel, fs);
+        double need = rate * (g_frameSizes.find(fmt)!=g_frameSizes.end()? g_frameSizes.at(fmt): 4);
+        if (need>linkRate) {
+            SoapySDR_logf(rateRefuse? SOAPY_SDR_ERROR: SOAPY_SDR_WARNING,
+                "SoapyTCPRemote::setSampleRate, %.1f Mbit/s exceeds link capacity %.1f Mbit/s",
+                need*8/1e6, linkRate*8/1e6);
+            if (rateRefuse)
+                throw std::runtime_error("sample rate exceeds link capacity");
+        }
+    }
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "sample_rate"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_SET_SAMPLE_RATE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
     rpc->writeDouble(rate);
-    rpc->readInteger(); // wait for completion!
+    complete("setSampleRate");
+    dynStore(changeKey(direction, channel, "sample_rate"), rate, gen, true);
 }
 
 double SoapyTCPRemote::getSampleRate(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getSampleRate()");
+    std::string key = changeKey(direction, channel, "sample_rate");
+    double val;
+    unsigned gen;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_SAMPLE_RATE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    return rpc->readDouble();
+    val = rpc->readDouble();
+    dynStore(key, val, gen, false);
+    return val;
 }
 
 std::vector<double> SoapyTCPRemote::listSampleRates(const int direction, const size_t channel) const
@@ -806,21 +1979,732 @@ std::vector<double> SoapyTCPRemote::listSampleRates(const int direction, const s
 SoapySDR::RangeList SoapyTCPRemote::getSampleRateRange(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getSampleRateRange()");
+    const ChannelCaps *cc = cached(direction, channel);
+    if (cc)
+        return cc->rateRange;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
     rpc->writeString(TCPREMOTE_RPC_SEP);
     rpc->writeInteger(TCPREMOTE_GET_SAMPLE_RATE_RANGE);
     rpc->writeInteger(direction);
     rpc->writeInteger(channel);
-    SoapySDR::RangeList list;
-    // read triplets of beg/end/step until step<0
+    return rpc->readRangeList();
+}
+
+// Bandwidth API
+void SoapyTCPRemote::setBandwidth(const int direction, const size_t channel, const double bw)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setBandwidth(%f)", bw);
+    if (remoteLevel<1)
+        throw std::runtime_error("setBandwidth not supported by remote");
+    unsigned gen = dynInvalidate(changeKey(direction, channel, "bandwidth"));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_BANDWIDTH);
+    rpc->writeInteger(direction);
+    rpc->writeInteger(channel);
+    rpc->writeDouble(bw);
+    complete("setBandwidth");
+    dynStore(changeKey(direction, channel, "bandwidth"), bw, gen, true);
+}
+
+double SoapyTCPRemote::getBandwidth(const int direction, const size_t channel) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getBandwidth()");
+    std::string key = changeKey(direction, channel, "bandwidth");
+    double val;
+    unsigned gen;
+    if (remoteLevel<1)
+        return 0;
+    if (dynLookup(direction, channel, key, val, gen))
+        return val;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_BANDWIDTH);
+    rpc->writeInteger(direction);
+    rpc->writeInteger(channel);
+    val = rpc->readDouble();
+    dynStore(key, val, gen, false);
+    return val;
+}
+
+SoapySDR::RangeList SoapyTCPRemote::getBandwidthRange(const int direction, const size_t channel) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getBandwidthRange()");
+    if (remoteLevel<1)
+        return SoapySDR::RangeList();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_BANDWIDTH_RANGE);
+    rpc->writeInteger(direction);
+    rpc->writeInteger(channel);
+    return rpc->readRangeList();
+}
+// Clocking API
+void SoapyTCPRemote::setMasterClockRate(const double rate)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setMasterClockRate(%f)", rate);
+    if (remoteLevel<3)
+        throw std::runtime_error("setMasterClockRate not supported by remote");
+    // may change any rate
+    dynInvalidate("");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_MASTER_CLOCK_RATE);
+    rpc->writeDouble(rate);
+    complete("setMasterClockRate");
+}
+double SoapyTCPRemote::getMasterClockRate(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getMasterClockRate()");
+    if (remoteLevel<3)
+        return 0.0;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_MASTER_CLOCK_RATE);
+    return rpc->readDouble();
+}
+SoapySDR::RangeList SoapyTCPRemote::getMasterClockRates(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getMasterClockRates()");
+    if (remoteLevel<3)
+        return SoapySDR::RangeList();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_MASTER_CLOCK_RATES);
+    return rpc->readRangeList();
+}
+std::vector<std::string> SoapyTCPRemote::listClockSources(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listClockSources()");
+    if (remoteLevel<3)
+        return std::vector<std::string>();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_LIST_CLOCK_SOURCES);
+    return rpc->readStrVector();
+}
+void SoapyTCPRemote::setClockSource(const std::string &source)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setClockSource(%s)", source.c_str());
+    if (remoteLevel<3)
+        throw std::runtime_error("setClockSource not supported by remote");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_CLOCK_SOURCE);
+    rpc->writeString(source);
+    complete("setClockSource");
+}
+std::string SoapyTCPRemote::getClockSource(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getClockSource()");
+    if (remoteLevel<3)
+        return "";
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_CLOCK_SOURCE);
+    return rpc->readString();
+}
+// Time API
+std::vector<std::string> SoapyTCPRemote::listTimeSources(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listTimeSources()");
+    if (remoteLevel<3)
+        return std::vector<std::string>();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_LIST_TIME_SOURCES);
+    return rpc->readStrVector();
+}
+void SoapyTCPRemote::setTimeSource(const std::string &source)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setTimeSource(%s)", source.c_str());
+    if (remoteLevel<3)
+        throw std::runtime_error("setTimeSource not supported by remote");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_TIME_SOURCE);
+    rpc->writeString(source);
+    complete("setTimeSource");
+}
+std::string SoapyTCPRemote::getTimeSource(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::getTimeSource()");
+    if (remoteLevel<3)
+        return "";
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_TIME_SOURCE);
+    return rpc->readString();
+}
+bool SoapyTCPRemote::hasHardwareTime(const std::string &what) const
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::hasHardwareTime(%s)", what.c_str());
+    if (remoteLevel<3)
+        return false;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_HAS_HARDWARE_TIME);
+    rpc->writeString(what);
+    return rpc->readInteger()>0;
+}
+long long SoapyTCPRemote::getHardwareTime(const std::string &what) const
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::getHardwareTime(%s)", what.c_str());
+    if (remoteLevel<3)
+        return 0;
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_GET_HARDWARE_TIME);
+    rpc->writeString(what);
+    return rpc->readLong();
+}
+void SoapyTCPRemote::setHardwareTime(const long long timeNs, const std::string &what)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setHardwareTime(%lld,%s)", timeNs, what.c_str());
+    if (remoteLevel<3)
+        throw std::runtime_error("setHardwareTime not supported by remote");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_HARDWARE_TIME);
+    rpc->writeLong(timeNs);
+    rpc->writeString(what);
+    complete("setHardwareTime");
+}
+void SoapyTCPRemote::setCommandTime(const long long timeNs, const std::string &what)
+{
+    // applies to the setters that follow, which with tcpremote:async are all pipelined
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::setCommandTime(%lld,%s)", timeNs, what.c_str());
+    if (remoteLevel<3)
+        throw std::runtime_error("setCommandTime not supported by remote");
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SET_COMMAND_TIME);
+    rpc->writeLong(timeNs);
+    rpc->writeString(what);
+    complete("setCommandTime");
+    // settings changed while timed may be read (& cached) again, the server tells us as they land
+    std::set<std::string> held;
+    {
+        std::lock_guard<std::mutex> lock(dynMutex);
+        cmdTimed = timeNs!=0;
+        if (!cmdTimed)
+            held.swap(dynHeld);
+    }
+    for (auto &scope: held)
+        dynInvalidate(scope);
+}
+// Sensor API
+std::vector<std::string> SoapyTCPRemote::listSensors(void) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listSensors()");
+    if (remoteLevel<4)
+        return std::vector<std::string>();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_LIST_SENSORS);
+    return rpc->readStrVector();
+}
+std::string SoapyTCPRemote::readSensor(const std::string &key) const
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::readSensor(%s)", key.c_str());
+    return readSensorRemote(-1, 0, key);
+}
+std::vector<std::string> SoapyTCPRemote::listSensors(const int direction, const size_t channel) const
+{
+    SoapySDR_log(SOAPY_SDR_TRACE, "SoapyTCPRemote::listSensors(dir,chn)");
+    if (remoteLevel<4)
+        return std::vector<std::string>();
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_LIST_CHANNEL_SENSORS);
+    rpc->writeInteger(direction);
+    rpc->writeInteger(channel);
+    return rpc->readStrVector();
+}
+std::string SoapyTCPRemote::readSensor(const int direction, const size_t channel, const std::string &key) const
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::readSensor(%d,%d,%s)", direction, (int)channel, key.c_str());
+    return readSensorRemote(direction, channel, key);
+}
+// latest pushed value & its age (msecs), if we have one
+bool SoapyTCPRemote::sensorLookup(const std::string &key, std::string &value, long long &age) const
+{
+    std::lock_guard<std::mutex> lock(sensorMutex);
+    auto it = sensorCache.find(key);
+    if (it==sensorCache.end())
+        return false;
+    value = it->second.value;
+    age = monotonicMs()-it->second.at;
+    return true;
+}
+std::string SoapyTCPRemote::readSensorRemote(const int direction, const size_t channel, const std::string &key) const
+{
+    std::string val;
+    long long age;
+    // pushed values are used unless not refreshed for a few intervals (remote stuck or gone?)
+    if (sensorLookup(changeKey(direction, channel, key.c_str()), val, age) && age<=3*sensorInterval)
+        return val;
+    if (remoteLevel<4)
+        return "";
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    if (direction<0) {
+        rpc->writeInteger(TCPREMOTE_READ_SENSOR);
+    } else {
+        rpc->writeInteger(TCPREMOTE_READ_CHANNEL_SENSOR);
+        rpc->writeInteger(direction);
+        rpc->writeInteger(channel);
+    }
+    rpc->writeString(key);
+    return rpc->readString();
+}
+// parse a sensor name: "<key>" for device sensors, "<rx|tx><chn>:<key>" for channel sensors
+static bool parseSensor(const std::string &item, int &dir, int &chn, std::string &key)
+{
+    dir = -1;
+    chn = 0;
+    key = item;
+    size_t col = item.find(':');
+    if (col!=std::string::npos && col>2 && (0==item.compare(0, 2, "rx") || 0==item.compare(0, 2, "tx"))) {
+        dir = 'r'==item[0]? SOAPY_SDR_RX: SOAPY_SDR_TX;
+        chn = atoi(item.substr(2, col-2).c_str());
+        key = item.substr(col+1);
+    }
+    return key.length()>0;
+}
+// ask the remote to push sensor values to our log stream every sensorInterval msecs,
+// spec is a space separated list of sensor names (empty to stop)
+int SoapyTCPRemote::subscribeSensors(const std::string &spec)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::subscribeSensors(%s)", spec.c_str());
+    if (remoteLevel<4 || logId<0) {
+        SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote: sensor subscriptions not supported by remote");
+        return -1;
+    }
+    std::vector<std::string> items;
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = spec.find(' ', cur);
+        if (nxt>cur)
+            items.push_back(spec.substr(cur, nxt-cur));
+    } while (nxt!=std::string::npos);
+    if (items.size()>(size_t)TCPREMOTE_MAX_ITEMS) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote: too many sensors to subscribe to (%d)", (int)items.size());
+        return -1;
+    }
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_SUBSCRIBE_SENSORS);
+    rpc->writeInteger(logId);
+    rpc->writeInteger(sensorInterval);
+    rpc->writeInteger(items.size());
+    for (auto &item: items) {
+        int dir, chn;
+        std::string key;
+        parseSensor(item, dir, chn, key);
+        rpc->writeInteger(dir);
+        rpc->writeInteger(chn);
+        rpc->writeString(key);
+    }
+    int status = rpc->readInteger();
+    std::lock_guard<std::mutex> lock(sensorMutex);
+    sensorCache.clear();
+    sensorSpec = status<0? "": spec;
+    if (status<0)
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote: sensor subscription failed: %d", status);
+    return status;
+}
+
+// NTP style clock sync with the remote, on a connection & thread of our own so exchanges
+// never wait behind RPCs (or hold them up)
+int SoapyTCPRemote::startClockSync()
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::startClockSync(%d)", clockInterval);
+    if (clockThread.joinable())
+        return 0;
+    if (remoteLevel<6) {
+        SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote: clock sync not supported by remote");
+        return -1;
+    }
+    int sock = connect();
+    if (sock<0)
+        return sock;
+    char req[8];
+    int rlen = sprintf(req, "%d\n", TCPREMOTE_CLOCK_SYNC);
+    if (write(sock, req, rlen)!=rlen) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "SoapyTCPRemote::startClockSync, failed to write request: %s", strerror(errno));
+        close(sock);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    clockSock = sock;
+    clockStop = false;
+    clockThread = std::thread(processClockSync, this);
+    return 0;
+}
+
+void SoapyTCPRemote::stopClockSync()
+{
+    if (!clockThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        clockStop = true;
+        // wakes an exchange in progress
+        shutdown(clockSock, SHUT_RDWR);
+    }
+    clockCond.notify_all();
+    clockThread.join();
+    close(clockSock);
+    clockSock = -1;
+}
+
+// one exchange: the reply has the remote clock as our request arrived & as it replied,
+// the round trip less the remote's time is network delay, which we assume symmetric
+static int clockExchange(int sock, long long &at, double &offset, long long &rtt)
+{
+    long long t1 = realtimeNs();
+    if (write(sock, "\n", 1)!=1)
+        return -1;
+    char rep[64];
+    size_t len = 0;
+    do {
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        ssize_t n = poll(&pfd, 1, 1000)>0? read(sock, rep+len, sizeof(rep)-1-len): -1;
+        if (n<=0)
+            return -1;
+        len += n;
+    } while (rep[len-1]!='\n' && len<sizeof(rep)-1);
+    long long t4 = realtimeNs();
+    rep[len] = 0;
+    long long t2, t3;
+    if (sscanf(rep, "%lld %lld", &t2, &t3)!=2)
+        return -1;
+    at = t1+(t4-t1)/2;
+    offset = ((double)(t2-t1)+(double)(t3-t4))/2;
+    rtt = (t4-t1)-(t3-t2);
+    return 0;
+}
+
+void SoapyTCPRemote::processClockSync(SoapyTCPRemote *rem)
+{
+    SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote: clock sync started");
+    size_t rounds = 0;
     while (true) {
-        double beg = rpc->readDouble();
-        double end = rpc->readDouble();
-        double step = rpc->readDouble();
-        if (step<0)
+        // a burst of exchanges, keeping the one least delayed by queueing
+        ClockSample best = { 0, 0, -1 }, sample;
+        for (int n=0; n<TCPREMOTE_CLOCK_BURST; ++n) {
+            if (clockExchange(rem->clockSock, sample.at, sample.offset, sample.rtt)<0) {
+                best.rtt = -1;
+                break;
+            }
+            if (best.rtt<0 || sample.rtt<best.rtt)
+                best = sample;
+        }
+        std::unique_lock<std::mutex> lock(rem->clockMutex);
+        if (rem->clockStop)
+            break;
+        if (best.rtt<0) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "SoapyTCPRemote: clock sync failed");
+            break;
+        }
+        rem->addClockSample(best);
+        // fill the window quickly at first, then every interval
+        int wait = ++rounds<TCPREMOTE_CLOCK_WINDOW && rem->clockInterval>1000? 1000: rem->clockInterval;
+        if (rem->clockCond.wait_for(lock, std::chrono::milliseconds(wait), [rem]{ return rem->clockStop; }))
             break;
-        list.push_back(SoapySDR::Range(beg,end,step));
     }
-    return list;
+    SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote: clock sync stopped");
+}
+
+// (with clockMutex held) estimate from the window's samples with round trips near the
+// lowest, as the others queued somewhere (quite possibly one way): offset by least squares
+// over time, the slope of which is the drift.
+void SoapyTCPRemote::addClockSample(const ClockSample &sample)
+{
+    clockSamples.push_back(sample);
+    if (clockSamples.size()>TCPREMOTE_CLOCK_WINDOW)
+        clockSamples.pop_front();
+    long long minRtt = sample.rtt;
+    for (auto &cs: clockSamples) {
+        if (cs.rtt<minRtt)
+            minRtt = cs.rtt;
+    }
+    // relative to the newest (secs), keeps the sums well conditioned
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (auto &cs: clockSamples) {
+        if (cs.rtt>2*minRtt)
+            continue;
+        double x = (cs.at-sample.at)/1e9;
+        n += 1;
+        sx += x;
+        sy += cs.offset;
+        sxx += x*x;
+        sxy += x*cs.offset;
+    }
+    double den = n*sxx-sx*sx;
+    double slope = n>=3 && den>0? (n*sxy-sx*sy)/den: 0;
+    clockOffset = (sy-slope*sx)/n;
+    clockDrift = slope/1e3;     // nsecs/sec => ppm
+    clockAt = sample.at;
+    clockRtt = minRtt;
+    clockValid = true;
+}
+
+// remote less local clock (nsecs) at local time now, if we have an estimate
+bool SoapyTCPRemote::clockEstimate(long long now, double &offset) const
+{
+    std::lock_guard<std::mutex> lock(clockMutex);
+    if (!clockValid)
+        return false;
+    offset = clockOffset + clockDrift*1e-6*(now-clockAt);
+    return true;
+}
+
+// apply several settings in one round trip, spec is a space separated list of
+// "<rx|tx><chn>:<setting>[:<name>]=<value>", applied in order by the remote, which
+// restores those already applied if one fails.
+void SoapyTCPRemote::batch(const std::string &spec)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::batch(%s)", spec.c_str());
+    std::vector<BatchOp> ops;
+    std::vector<std::string> items;
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = spec.find(' ', cur);
+        std::string item = spec.substr(cur, nxt-cur);
+        if (item.length()==0)
+            continue;
+        BatchOp op;
+        size_t colon = item.find(':');
+        size_t eq = item.find('=');
+        if (colon==std::string::npos || eq==std::string::npos || eq<colon || colon<3)
+            throw std::runtime_error("tcpremote:batch, bad operation: "+item);
+        std::string dir = item.substr(0, 2);
+        op.dir = "rx"==dir? SOAPY_SDR_RX: "tx"==dir? SOAPY_SDR_TX: -1;
+        if (op.dir<0)
+            throw std::runtime_error("tcpremote:batch, bad direction: "+item);
+        op.chn = strtoul(item.substr(2, colon-2).c_str(), nullptr, 10);
+        op.setting = item.substr(colon+1, eq-colon-1);
+        size_t sub = op.setting.find(':');
+        if (sub!=std::string::npos) {
+            op.name = op.setting.substr(sub+1);
+            op.setting = op.setting.substr(0, sub);
+        }
+        op.value = item.substr(eq+1);
+        ops.push_back(op);
+        items.push_back(item);
+    } while (nxt!=std::string::npos);
+    batchStatus = "";
+    if (ops.empty())
+        return;
+    if (ops.size()>(size_t)TCPREMOTE_MAX_ITEMS)
+        throw std::runtime_error("tcpremote:batch, too many operations");
+    if (remoteLevel<1) {
+        // older remote, one at a time
+        SoapySDR_log(SOAPY_SDR_DEBUG, "SoapyTCPRemote: batch unavailable, applying singly");
+        for (auto &op: ops) {
+            applyOp(op);
+            batchStatus += batchStatus.empty()? "0": " 0";
+        }
+        return;
+    }
+    std::vector<unsigned> gens;
+    for (auto &op: ops)
+        gens.push_back(dynInvalidate(changeKey(op.dir, op.chn, op.setting.c_str())));
+    std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+    rpc->writeString(TCPREMOTE_RPC_SEP);
+    rpc->writeInteger(TCPREMOTE_BATCH);
+    rpc->writeInteger(ops.size());
+    for (auto &op: ops) {
+        rpc->writeInteger(op.dir);
+        rpc->writeInteger(op.chn);
+        rpc->writeString(op.setting);
+        rpc->writeString(op.name);
+        rpc->writeString(op.value);
+    }
+    int num = rpc->readInteger();
+    if (num!=(int)ops.size())
+        throw std::runtime_error("tcpremote:batch, bad response from remote");
+    std::string failed;
+    for (size_t idx=0; idx<ops.size(); ++idx) {
+        int status = rpc->readInteger();
+        batchStatus += (idx? " ": "") + std::to_string(status);
+        if (status<0)
+            failed = items[idx];
+        if (status!=0 || "antenna"==ops[idx].setting)
+            continue;
+        std::string key = changeKey(ops[idx].dir, ops[idx].chn, ops[idx].setting.c_str());
+        if (!ops[idx].name.empty())
+            key += " " + ops[idx].name;
+        double val = "gain_mode"==ops[idx].setting? ("true"==ops[idx].value || "1"==ops[idx].value):
+            strtod(ops[idx].value.c_str(), nullptr);
+        dynStore(key, val, gens[idx], true);
+    }
+    if (!failed.empty())
+        throw std::runtime_error("tcpremote:batch failed on remote: "+failed);
+}
+
+// a batch operation via the single setters
+void SoapyTCPRemote::applyOp(const BatchOp &op)
+{
+    double val = strtod(op.value.c_str(), nullptr);
+    if ("frequency"==op.setting) {
+        if (op.name.empty())
+            setFrequency(op.dir, op.chn, val);
+        else
+            setFrequency(op.dir, op.chn, op.name, val);
+    } else if ("gain"==op.setting) {
+        if (op.name.empty())
+            setGain(op.dir, op.chn, val);
+        else
+            setGain(op.dir, op.chn, op.name, val);
+    } else if ("gain_mode"==op.setting)
+        setGainMode(op.dir, op.chn, "true"==op.value || "1"==op.value);
+    else if ("sample_rate"==op.setting)
+        setSampleRate(op.dir, op.chn, val);
+    else if ("bandwidth"==op.setting)
+        setBandwidth(op.dir, op.chn, val);
+    else if ("frequency_correction"==op.setting)
+        setFrequencyCorrection(op.dir, op.chn, val);
+    else
+        throw std::runtime_error("tcpremote:batch, unsupported setting: "+op.setting);
+}
+
+// Settings API, our own tcpremote:<x> keys only
+std::string SoapyTCPRemote::readSetting(const std::string &key) const
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::readSetting(%s)", key.c_str());
+    if ("tcpremote:link_rate"==key)
+        return std::to_string(linkRate);
+    if ("tcpremote:link_rtt"==key)
+        return std::to_string(linkRtt);
+    if ("tcpremote:async"==key)
+        return async? "true": "false";
+    if ("tcpremote:access"==key)
+        return access;
+    if ("tcpremote:cache"==key)
+        return described? "true": "false";
+    if ("tcpremote:batch_status"==key)
+        return batchStatus;
+    if ("tcpremote:dwell"==key)
+        return dwellInfo;
+    if ("tcpremote:clock"==key) {
+        // "<offset> <drift> <rtt>": remote less local clock (nsecs), drift (ppm), lowest round trip (nsecs)
+        double offset;
+        if (!clockEstimate(realtimeNs(), offset))
+            return "";
+        std::lock_guard<std::mutex> lock(clockMutex);
+        char info[80];
+        snprintf(info, sizeof(info), "%.0f %.3f %lld", offset, clockDrift, clockRtt);
+        return info;
+    }
+    if (0==key.compare(0, 19, "tcpremote:to_local:")) {
+        // a remote clock time (nsecs) on our clock
+        double offset;
+        if (!clockEstimate(realtimeNs(), offset))
+            return "";
+        return std::to_string(strtoll(key.c_str()+19, nullptr, 10)-(long long)offset);
+    }
+    if ("tcpremote:latency"==key) {
+        // usecs from the first sample of the last server stamped block, until we read it
+        std::lock_guard<std::mutex> lock(clockMutex);
+        return latencyValid? std::to_string(latencyNs/1000): "";
+    }
+    if ("tcpremote:activation"==key) {
+        // "<activate> <first sample>" usecs, for the latest activateStream() (first sample empty until read)
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (activateUs<0)
+            return "";
+        return std::to_string(activateUs)+(firstSampleUs<0? "": " "+std::to_string(firstSampleUs));
+    }
+    if ("tcpremote:stream_stats"==key) {
+        // "<remoteId>:<rate>[,<rate>..] ..." bytes/sec on each data connection of each stream, since last asked
+        std::lock_guard<std::mutex> lock(statsMutex);
+        long long now = monotonicMs();
+        std::string stats;
+        for (auto stream: streams) {
+            double secs = (now-stream->statAt)/1e3;
+            stats += (stats.length()>0? " ": "")+std::to_string(stream->remoteId);
+            for (auto &st: stream->stripes) {
+                stats += (&st==&stream->stripes[0]? ":": ",")+std::to_string((long long)(secs>0? (st.bytes-st.statBytes)/secs: 0));
+                st.statBytes = st.bytes;
+            }
+            stream->statAt = now;
+        }
+        return stats;
+    }
+    if ("tcpremote:clock_sync"==key)
+        return std::to_string(clockInterval);
+    if ("tcpremote:clock_local"==key)
+        return clockLocal? "true": "false";
+    if ("tcpremote:sensors"==key) {
+        std::lock_guard<std::mutex> lock(sensorMutex);
+        return sensorSpec;
+    }
+    if (0==key.compare(0, 21, "tcpremote:sensor_age:")) {
+        // msecs since the named sensor was last pushed
+        int dir, chn;
+        std::string name, val;
+        long long age;
+        if (parseSensor(key.substr(21), dir, chn, name) && sensorLookup(changeKey(dir, chn, name.c_str()), val, age))
+            return std::to_string(age);
+        return "";
+    }
+    if ("tcpremote:async_errors"==key) {
+        // collect anything in flight first
+        std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+        rpc->collectDeferred();
+        return std::to_string(rpc->numFailed());
+    }
+    if ("tcpremote:last_error"==key) {
+        std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+        rpc->collectDeferred();
+        return rpc->getLastError();
+    }
+    return "";
+}
+
+void SoapyTCPRemote::writeSetting(const std::string &key, const std::string &value)
+{
+    SoapySDR_logf(SOAPY_SDR_TRACE, "SoapyTCPRemote::writeSetting(%s,%s)", key.c_str(), value.c_str());
+    if ("tcpremote:probe"==key)
+        probeLink(atoi(value.c_str()));
+    else if ("tcpremote:rate_check"==key)
+        rateRefuse = "refuse"==value;
+    else if ("tcpremote:cache_policy"==key)
+        parsePolicy(value);
+    else if ("tcpremote:async"==key) {
+        async = "true"==value;
+        if (!async) {
+            std::lock_guard<std::recursive_mutex> rpcLock(rpcMutex);
+            rpc->collectDeferred();
+        }
+    }
+    else if ("tcpremote:access"==key) {
+        if (setAccess(value)<0)
+            throw std::runtime_error("unable to change access to remote device");
+    }
+    else if ("tcpremote:batch"==key)
+        batch(value);
+    else if ("tcpremote:sensors"==key)
+        subscribeSensors(value);
+    else if ("tcpremote:clock_sync"==key) {
+        stopClockSync();
+        clockInterval = atoi(value.c_str());
+        if (clockInterval>0)
+            startClockSync();
+    }
+    else if ("tcpremote:clock_local"==key)
+        clockLocal = "true"==value;
+    else if ("tcpremote:sensor_interval"==key) {
+        sensorInterval = atoi(value.c_str());
+        if (sensorSpec.length()>0)
+            subscribeSensors(sensorSpec);
+    }
 }
 
 std::string getConfFile() {
@@ -907,10 +2791,16 @@ SoapySDR::KwargsList findTCPRemote(const SoapySDR::Kwargs &args)
     } else {
         driver = args.at("tcpremote:driver");
     }
-    size_t colon = address.find(':',0);
+    // <host>[:<port>], IPv6 literals are bracketed to add a port: [<addr>]:<port>
     // no port, default to 0x50AF (20655)
     int port = 0x50AF;
-    if (colon != (size_t)-1) {
+    size_t colon = address.rfind(':');
+    if (address.length()>0 && '['==address[0]) {
+        size_t close = address.find(']');
+        if (close!=(size_t)-1 && colon!=(size_t)-1 && colon>close)
+            port = atoi(address.substr(colon+1).c_str());
+        address = address.substr(1, close-1);
+    } else if (colon!=(size_t)-1 && colon==address.find(':')) {
         port = atoi(address.substr(colon+1).c_str());
         address = address.substr(0, colon);
     }
@@ -937,7 +2827,7 @@ SoapySDR::Device *makeTCPRemote(const SoapySDR::Kwargs &args)
     std::string port = args.at("port");
     std::string remdriver = args.at("tcpremote:driver");
     std::string remargs = args.at("tcpremote:args");
-    return (SoapySDR::Device*) new SoapyTCPRemote(address, port, remdriver, remargs);
+    return (SoapySDR::Device*) new SoapyTCPRemote(address, port, remdriver, remargs, args);
 }
 
 /* Register this driver */
@@ -6,12 +6,30 @@
 #define SoapyTCPRemote_hpp
 
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <deque>
+#include <set>
 
 #include <SoapySDR/Device.hpp>
 #include <SoapySDR/Registry.hpp>
 #include <SoapySDR/Version.hpp>
 
 #include "SoapyRPC.hpp"
+#include "SoapyMux.hpp"
+
+// default connect timeout, and delay between starting attempts to each address (msecs)
+const int TCPREMOTE_CONNECT_TIMEOUT = 10000;
+const int TCPREMOTE_CONNECT_DELAY = 250;
+
+// default clock sync interval (msecs), exchanges per sync & syncs kept for estimates
+const int TCPREMOTE_CLOCK_INTERVAL = 10000;
+const int TCPREMOTE_CLOCK_BURST = 8;
+const size_t TCPREMOTE_CLOCK_WINDOW = 8;
+
+// most data connections a stream may be striped across
+const int TCPREMOTE_MAX_STRIPES = 16;
 
 class SoapyTCPRemote : public SoapySDR::Device
 {
@@ -22,23 +40,160 @@ private:
     const std::string remotePort;
     const std::string remoteDriver;
     const std::string remoteArgs;
-    // requested & wire formats, as we may choose smaller native format
-    std::string fmtout;
-    std::string fmtwire;
-    // network connect
+    // network connect, a new TCP connection or a channel in our session
     int connect() const;
-    // RPC handler
+    int connectTCP() const;
+    int connectSession(size_t window);
+    SoapyMux *mux;
+    // connect timeout (msecs) & the address that answered first, reused for later connections
+    int connectTimeout;
+    mutable std::mutex peerMutex;
+    mutable struct sockaddr_storage peerAddr;
+    mutable socklen_t peerLen;
+    // RPC handler, one exchange at a time (we may be called from several threads, eg: by a relay)
     SoapyRPC *rpc;
-    // Log stream, ID and thread
+    mutable std::recursive_mutex rpcMutex;
+    // Log stream, ID and thread, which connects it while we load the remote driver
     FILE *log;
     int logId;
     std::thread logThread;
+    enum { LOG_FAILED=-1, LOG_CONNECTING, LOG_REQUESTED, LOG_READY };
+    int logState;
+    std::mutex logMutex;
+    std::condition_variable logCond;
+    // link capacity (bytes/sec) & round trip time (usecs) from last probe, refuse rates beyond?
+    double linkRate;
+    double linkRtt;
+    bool rateRefuse;
+    // pipelined setters, status collected by the next read
+    bool async;
+    // remote protocol level (TCPREMOTE_PROTOCOL_LEVEL), from codec negotiation
+    int remoteLevel;
+    // our access to the remote device, shared with any other clients of it: shared, control or observe
+    std::string access;
+    // static capabilities from the describe RPC (if supported & enabled), by direction & channel
+    struct ChannelCaps
+    {
+        SoapySDR::Kwargs info;
+        bool fullDuplex;
+        std::vector<std::string> formats;
+        std::string nativeFormat;
+        double fullScale;
+        std::vector<std::string> gains;
+        bool hasGainMode;
+        SoapySDR::Range gainRange;
+        std::map<std::string, SoapySDR::Range> gainRanges;
+        std::vector<std::string> freqs;
+        SoapySDR::RangeList freqRange;
+        std::map<std::string, SoapySDR::RangeList> freqRanges;
+        SoapySDR::RangeList rateRange;
+        bool hasFreqCorrection;
+    };
+    bool useCache;
+    bool described;
+    std::string capKey;
+    SoapySDR::Kwargs capInfo;
+    std::vector<ChannelCaps> caps[2];
+    // dynamic settings cache, keyed by changeKey() [+ " <name>"], discarded by remote change
+    // events, with a caching policy per setting (enabled once we are subscribed to events)
+    enum { CACHE_OFF, CACHE_READ, CACHE_WRITE };
+    std::map<std::string, int> dynPolicy;
+    bool dynEvents;
+    mutable std::mutex dynMutex;
+    mutable std::map<std::string, double> dynCache;
+    mutable unsigned dynGen;
+    // while a command time is set, what timed setters change (as dynInvalidate() scopes) is not
+    // cached, as the old values stand until then, & is discarded again once it is cleared
+    bool cmdTimed;
+    mutable std::set<std::string> dynHeld;
+    // batched setters, named as in change keys, & per operation status of the last batch
+    struct BatchOp
+    {
+        int dir;
+        size_t chn;
+        std::string setting;
+        std::string name;
+        std::string value;
+    };
+    std::string batchStatus;
+    // current dwell of a hop scheduled stream (from its last marker), as "<index> <pass> <frequency>"
+    std::string dwellInfo;
+    // pushed sensor values, keyed by changeKey() (direction -1 for device sensors), with arrival
+    // time (msecs), and the subscription they come from
+    struct SensorValue
+    {
+        std::string value;
+        long long at;
+    };
+    mutable std::mutex sensorMutex;
+    std::map<std::string, SensorValue> sensorCache;
+    std::string sensorSpec;
+    int sensorInterval;
+    // clock sync on a connection of our own, a burst of exchanges every clockInterval msecs
+    // (0=off), keeping the lowest round trip of each. Estimates remote-local clock offset
+    // (nsecs, at local time clockAt) & drift (ppm) from the recent ones with low round trips.
+    struct ClockSample
+    {
+        long long at;
+        double offset;
+        long long rtt;
+    };
+    int clockInterval;
+    std::thread clockThread;
+    int clockSock;
+    bool clockStop;
+    mutable std::mutex clockMutex;
+    std::condition_variable clockCond;
+    std::deque<ClockSample> clockSamples;
+    bool clockValid;
+    double clockOffset;
+    double clockDrift;
+    long long clockAt;
+    long long clockRtt;
+    // return server stamped stream times on our clock? & the latency of the last such block
+    bool clockLocal;
+    bool latencyValid;
+    long long latencyNs;
+    // latest activation: round trip & until its first samples were read (usecs, -1 not yet)
+    long long activateUs;
+    long long firstSampleUs;
+    // open streams, for their stats
+    mutable std::mutex statsMutex;
+    std::set<SoapySDR::Stream *> streams;
     // helpers
     int loadRemoteDriver() const;
+    int getLevel();
+    int setCodec(const std::string &codec);
+    int setAccess(const std::string &want);
+    void complete(const char *what);
+    int describe();
+    const ChannelCaps *cached(const int direction, const size_t channel) const;
+    int parsePolicy(const std::string &spec);
+    int subscribeEvents();
+    int keyPolicy(const std::string &key) const;
+    bool dynLookup(const int direction, const size_t channel, const std::string &key, double &val, unsigned &gen) const;
+    void dynStore(const std::string &key, double val, unsigned gen, bool written) const;
+    unsigned dynInvalidate(const std::string &key) const;
     int connectLogStream(SoapySDRLogLevel level);
-    static void processLogStream(SoapyTCPRemote *rem);
+    void setLogState(int state);
+    int waitLogState(int state);
+    void closeLogStream();
+    static void processLogStream(SoapyTCPRemote *rem, SoapySDRLogLevel level);
+    int probeLink(int msecs);
+    void batch(const std::string &spec);
+    void applyOp(const BatchOp &op);
+    int subscribeSensors(const std::string &spec);
+    bool sensorLookup(const std::string &key, std::string &value, long long &age) const;
+    std::string readSensorRemote(const int direction, const size_t channel, const std::string &key) const;
+    int startClockSync();
+    void stopClockSync();
+    static void processClockSync(SoapyTCPRemote *rem);
+    int connectData(const int direction, int &remoteId);
+    int nextBlock(SoapySDR::Stream *stream, const long timeoutUs);
+    void addClockSample(const ClockSample &sample);
+    bool clockEstimate(long long now, double &offset) const;
 public:
-    SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs);
+    SoapyTCPRemote(const std::string &address, const std::string &port, const std::string &remdriver, const std::string &remargs, const SoapySDR::Kwargs &args);
     ~SoapyTCPRemote();
 
     // Identification API (driver local, others remote)
@@ -137,7 +292,39 @@ public:
     std::vector<double> listSampleRates(const int direction, const size_t channel) const;
     SoapySDR::RangeList getSampleRateRange(const int direction, const size_t channel) const;
 
-    // Bandwidth, Clocking, Time, Sensor, Register, Settings, GPIO, I2C, SPI, UART APIs (not yet!)
+    // Bandwidth API (all remote, listBandwidths is emulated from the range by SoapySDR)
+    void setBandwidth(const int direction, const size_t channel, const double bw);
+    double getBandwidth(const int direction, const size_t channel) const;
+    SoapySDR::RangeList getBandwidthRange(const int direction, const size_t channel) const;
+
+    // Clocking API (all remote)
+    void setMasterClockRate(const double rate);
+    double getMasterClockRate(void) const;
+    SoapySDR::RangeList getMasterClockRates(void) const;
+    std::vector<std::string> listClockSources(void) const;
+    void setClockSource(const std::string &source);
+    std::string getClockSource(void) const;
+
+    // Time API (all remote, timed commands may be pipelined with tcpremote:async)
+    std::vector<std::string> listTimeSources(void) const;
+    void setTimeSource(const std::string &source);
+    std::string getTimeSource(void) const;
+    bool hasHardwareTime(const std::string &what = "") const;
+    long long getHardwareTime(const std::string &what = "") const;
+    void setHardwareTime(const long long timeNs, const std::string &what = "");
+    void setCommandTime(const long long timeNs, const std::string &what = "");
+
+    // Sensor API (all remote, subscribed sensors are pushed and read locally)
+    std::vector<std::string> listSensors(void) const;
+    std::string readSensor(const std::string &key) const;
+    std::vector<std::string> listSensors(const int direction, const size_t channel) const;
+    std::string readSensor(const int direction, const size_t channel, const std::string &key) const;
+
+    // Settings API (local tcpremote:<x> settings only, remote not yet!)
+    std::string readSetting(const std::string &key) const;
+    void writeSetting(const std::string &key, const std::string &value);
+
+    // Register, GPIO, I2C, SPI, UART APIs (not yet!)
 };
 
 #endif /* SoapyTCPRemote_hpp */
@@ -3,12 +3,19 @@
 //  SPDX-License-Identifier: BSL-1.0
 
 // Design approach is KISS, main thread accepts connections into a
-// map, handles RPCs. Log connections exist separately (allowing
-// custom network loggers).
-// Worker threads are created per data stream to pump in/out.
+// map (an epoll reactor, each connection registered once with its
+// handler), routing RPCs to a worker thread per RPC connection (so
+// per device). Log connections exist separately (allowing custom
+// network loggers).
+// Worker threads are created per data stream to pump in/out, parked
+// between activations until the stream closes.
 #include <SoapySDR/Device.hpp>
 #include "SoapyRPC.hpp"
+#include "SoapyData.hpp"
+#include "SoapyMux.hpp"
 #include "SoapyLog.hpp"
+#include "SoapyReactor.hpp"
+#include "SoapyBuffer.hpp"
 #include <signal.h>
 #include <pthread.h>
 #include <unistd.h>
@@ -16,8 +23,17 @@
 #include <poll.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/sockios.h>
 #include <netdb.h>
 #include <unordered_set>
+#include <set>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
 
 struct pipebuf_t {
     void *buf;
@@ -26,40 +42,218 @@ struct pipebuf_t {
     pthread_cond_t rd, wr;
 };
 
+// a boundary in a data stream, at an element offset in netPipe
+struct StreamMark
+{
+    uint64_t at;
+    enum { DWELL, END, LAST, TIME } kind;   // dwell start (with details), dwell end, burst end (stop), time
+    TCPRemoteDwell dwell;
+    // time of the sample at this mark (TIME), from the driver or our own clock (host)
+    long long timeNs;
+    bool host;
+};
+
+// sensors sampled every interval msecs by a thread of its own, values pushed to a log
+// stream as "S:<dir> <chn> <key>=<value>" (dir -1 for device sensors)
+struct SensorWatch
+{
+    struct Sensor
+    {
+        int dir;
+        int chn;
+        std::string key;
+    };
+    SoapySDR::Device *dev;
+    // taken around each sample, as for an RPC (so we take turns with clients of the device)
+    std::mutex *rpcMutex;
+    int logId;
+    int interval;
+    std::vector<Sensor> sensors;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stop;
+};
+
+// each RPC connection is served by a worker thread of its own (from before its device is made,
+// which can take seconds), so a slow driver call only holds up its own client. The main loop
+// queues a task here each time the connection is readable.
+struct RpcWorker
+{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> tasks;
+    bool stop;
+    // connection dropped, ignore anything still queued
+    bool dropped;
+};
+
+// a stream's data & network pump threads, with the pipe between them, are started by its first
+// activation and parked between activations (so reactivating is just a wake up), until the
+// stream is closed.
+struct StreamPumps
+{
+    pthread_t data, net;
+    std::mutex mutex;
+    std::condition_variable cond;
+    // runs asked of & completed by each pump (it is running while they differ), & shut down
+    uint32_t dataWant, dataRan, netWant, netRan;
+    bool quit;
+    // timing of the latest activation: asked for (CLOCK_MONOTONIC), underlying stream active
+    // after (usecs), & first samples sent yet
+    struct timespec asked;
+    long activeUs;
+    bool sent;
+    // data pump: pipe, then read & interleave buffers (readSize each), network pump: write &
+    // convert buffers (netElems each), each near its pump
+    SoapyBuffer dataMem, netMem;
+    size_t readSize, netElems;
+};
+
+// A receive stream shared by the data connections of any clients of a device asking for it
+// (tcpremote:fanout=true) with the same channels: the device is read once, by a reader thread of
+// its own, into a ring of interleaved samples that each connection's network pump sends from at
+// its own pace, in its own wire format. The reader never waits for them: a connection that falls
+// a ring behind skips ahead, losing only its own data. The device stream is active while any of
+// its connections is.
+struct StreamFanout
+{
+    SoapySDR::Device *dev;
+    // its clients' RPC lock, held around driver calls other than streaming
+    std::mutex *rpcMutex;
+    SoapySDR::Stream *stream;
+    // read format (of the first connection), its code & frame size, channels
+    std::string format;
+    int fmtCode;
+    size_t fSize;
+    std::vector<size_t> channels;
+    // elements per read, in the ring, & their size
+    size_t readElems, ringElems, elemSize;
+    // the ring, then the read buffers (readElems per channel)
+    SoapyBuffer mem;
+    // elements written, & as far as a write in progress goes (senders check this after copying
+    // out, in case what they copied was overwritten)
+    std::atomic<uint64_t> head, reserve;
+    // time marks of samples still in the ring, & the rate to time those between them (guarded by mutex)
+    std::deque<StreamMark> marks;
+    double sampleRate;
+    // connections sharing it & those active (guarded by the device's rpcMutex)
+    int refs, active;
+    // reader thread: runs asked & completed, keep reading, shut down
+    pthread_t reader;
+    uint32_t want, ran;
+    volatile bool running;
+    bool quit;
+    // wakes the reader for a run, & senders for more samples
+    std::mutex mutex;
+    std::condition_variable cond;
+};
+
+// where & how pump threads run: CPUs for the data (device reader) & network (sender) pumps
+// (empty for any), or the next isolated CPUs for each stream, & the scheduling policy & priority
+// of both, then how their buffers are allocated (TCPREMOTE_BUFFER_*, bound to the node of
+// the first CPU given). Configured (by server option or stream argument) failures are
+// warnings, else debug.
+struct PumpSched
+{
+    PumpSched(): isolated(false), policy(SCHED_FIFO), priority(1), configured(false), buffers(TCPREMOTE_BUFFER_NUMA), bufConfigured(false) {}
+    std::vector<int> dataCpus, netCpus;
+    bool isolated;
+    int policy, priority;
+    bool configured;
+    int buffers;
+    bool bufConfigured;
+};
+
+struct SharedDevice;
+
 struct ConnectionInfo
 {
 // default constructor clears all values
-    ConnectionInfo(): rpc(nullptr), dev(nullptr), netSock(0), netPipe(nullptr), direction(0), stream(nullptr), pid(0), log(nullptr), level(SOAPY_SDR_INFO) {}
+    ConnectionInfo(): rpc(nullptr), worker(nullptr), dev(nullptr), shared(nullptr), access(0), sensors(nullptr), netSock(0), netPipe(nullptr), framed(false), direction(0), stream(nullptr), fanout(nullptr), joined(false), running(false), pumps(nullptr), wireLevel(0), adaptHigh(50), adaptLow(10), adaptHold(2000), seq(0), sampleRate(0), hopSettle(0), hopPasses(0), actFlags(0), actTime(0), actElems(0), paceRate(0), paceKernel(false), paceTokens(0), paceLast(), log(nullptr), level(SOAPY_SDR_INFO), logDropped(0), logOwner(-1), events(-1), cmdTime(0) {}
 // RPC connection bits
     // NB: existance of an rpc object implies this is an RPC connection, otherwise data stream
     SoapyRPC *rpc;
-    // our underlying real device
+    // the thread our RPCs run on
+    RpcWorker *worker;
+    // our underlying real device, shared with other clients asking for the same one (by its
+    // kwargs, see attachDevice()), & our access to it
     SoapySDR::Device *dev;
+    std::string devKey;
+    SharedDevice *shared;
+    int access;
     // a set of data connections / streams for this device
     std::unordered_set<int> dataIds;
+    // sensor subscription, if any
+    SensorWatch *sensors;
 // data connection bits
-    // the raw socket
+    // the raw socket, & any more striped with it (blocks go to whichever has least unsent)
     int netSock;
+    std::vector<int> stripes;
     // our memory buffer & inter-thread storage
     pipebuf_t *netPipe;
+    // sent in blocks (TCPREMOTE_DATA_SEND_BLOCKS), else bare samples in the stream format
+    bool framed;
     // which way are we going
     int direction;
     // selected stream format
     std::string format;
     // selected channels
     std::vector<size_t> channels;
-    // our underlying device stream
+    // our underlying device stream, & if shared the fanout it belongs to & whether we are active in it
     SoapySDR::Stream *stream;
-    // thread ID (for data pump)
-    volatile pthread_t pid;
+    StreamFanout *fanout;
+    bool joined;
+    // activated (pumps keep going while set), & the pump threads, with their placement
+    volatile bool running;
+    StreamPumps *pumps;
+    PumpSched sched;
+    // adaptive wire format ladder (level 0 is the stream format) & current level
+    std::vector<TCPRemoteLevel> wireLevels;
+    size_t wireLevel;
+    // send queue thresholds (% of send buffer) & step up hold time (msecs)
+    int adaptHigh, adaptLow, adaptHold;
+    // next block sequence number
+    uint32_t seq;
+    // stream sample rate, to time blocks between TIME marks (0 unknown)
+    double sampleRate;
+    // hop schedule (frequency, dwell secs), settle time (secs) & passes (0=forever)
+    std::vector<std::pair<double, double>> hops;
+    double hopSettle;
+    int hopPasses;
+    // activation flags, time & burst length (0=continuous)
+    int actFlags;
+    long long actTime;
+    size_t actElems;
+    // stream marks from dataPump to netPump (guarded by the netPipe mutex)
+    std::deque<StreamMark> marks;
+    // uplink pacing (see scheduleBandwidth()): rate (bytes/sec, 0 unpaced), whether the kernel
+    // paces our socket, else our token bucket's tokens (bytes) as of paceLast
+    volatile double paceRate;
+    volatile bool paceKernel;
+    double paceTokens;
+    struct timespec paceLast;
 // log stream bits
     FILE *log;
     SoapySDRLogLevel level;
+    // output the socket would not take yet (see logSend()), & lines dropped since it filled
+    std::string logBacklog;
+    unsigned logDropped;
+    // RPC connection of the client it belongs to (see claimLog(), -1 not yet known)
+    int logOwner;
+    // RPC connection whose device change events we also forward (-1 none)
+    int events;
+// timed command bits
+    // device time (nsecs) & clock setters now apply at (0 at once), see notifySetter()
+    long long cmdTime;
+    std::string cmdWhat;
 };
 
-pipebuf_t *newpipe(int size) {
-    pipebuf_t *pipe = (pipebuf_t *)malloc(sizeof(pipebuf_t)+size);
-    pipe->buf = pipe+1;
+// a pipe over the given buffer (free() the pipe, not the buffer)
+pipebuf_t *newpipe(void *buf, int size) {
+    pipebuf_t *pipe = (pipebuf_t *)malloc(sizeof(pipebuf_t));
+    pipe->buf = buf;
     pipe->len = size;
     pipe->in = pipe->out = 0;
     pthread_mutex_init(&pipe->mutex, NULL);
@@ -158,12 +352,473 @@ int piperead(void *dst, int sz, int num, pipebuf_t *pipe, bool block = true) {
     return rv;
 }
 
+// pipe space used, as a percentage
+int pipeused(pipebuf_t *pipe) {
+    pthread_mutex_lock(&pipe->mutex);
+    int us = pipe->in-pipe->out;
+    if (us<0) us += pipe->len;
+    pthread_mutex_unlock(&pipe->mutex);
+    return (int)((long)us*100/pipe->len);
+}
+
+// stream marks are queued before the samples they refer to are written to the pipe,
+// so netPump always finds a mark before it reads past that point
+void pushMark(ConnectionInfo *conn, const StreamMark &mark) {
+    pthread_mutex_lock(&conn->netPipe->mutex);
+    conn->marks.push_back(mark);
+    pthread_mutex_unlock(&conn->netPipe->mutex);
+}
+
+// pull back marks beyond what a short pipe write delivered (before writing any more)
+void moveMarks(ConnectionInfo *conn, uint64_t at) {
+    pthread_mutex_lock(&conn->netPipe->mutex);
+    for (auto &m: conn->marks) {
+        if (m.at>at)
+            m.at = at;
+    }
+    pthread_mutex_unlock(&conn->netPipe->mutex);
+}
+
+// remove the next mark, if it is at or before the given element offset
+bool takeMark(ConnectionInfo *conn, uint64_t limit, StreamMark &mark) {
+    bool rv = false;
+    pthread_mutex_lock(&conn->netPipe->mutex);
+    if (!conn->marks.empty() && conn->marks.front().at<=limit) {
+        mark = conn->marks.front();
+        conn->marks.pop_front();
+        rv = true;
+    }
+    pthread_mutex_unlock(&conn->netPipe->mutex);
+    return rv;
+}
+
+// server wide pump placement (-a, -r), streams may override with tcpremote:cpus & tcpremote:sched
+static PumpSched s_pumpSched;
+// isolated CPUs (from the kernel's isolcpus), & the next to hand out
+static std::vector<int> s_isolatedCpus;
+static std::atomic<unsigned> s_nextIsolated(0);
+
+// CPU list, eg: "2", "2,3" (or "2 3", as commas separate stream arguments) or "0-3"
+bool parseCpus(const std::string &spec, std::vector<int> &cpus) {
+    cpus.clear();
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = spec.find_first_of(", ", cur);
+        std::string item = spec.substr(cur, nxt-cur);
+        char *end;
+        long lo = strtol(item.c_str(), &end, 10), hi = lo;
+        if (end==item.c_str())
+            return false;
+        if ('-'==*end) {
+            const char *from = end+1;
+            hi = strtol(from, &end, 10);
+            if (end==from)
+                return false;
+        }
+        if (*end || lo<0 || hi<lo || hi>=CPU_SETSIZE)
+            return false;
+        for (long cpu=lo; cpu<=hi; ++cpu)
+            cpus.push_back((int)cpu);
+    } while (nxt!=std::string::npos);
+    return true;
+}
+
+std::string cpuList(const std::vector<int> &cpus) {
+    std::string list;
+    for (int cpu: cpus)
+        list += (list.length()>0? ",": "")+std::to_string(cpu);
+    return list.length()>0? list: "any";
+}
+
+// "<cpus>[/<cpus>]" data pump CPUs, & network pump CPUs if different, or "isolated"
+bool parseAffinity(const std::string &spec, PumpSched &sched) {
+    sched.isolated = "isolated"==spec;
+    if (sched.isolated) {
+        sched.dataCpus.clear();
+        sched.netCpus.clear();
+    } else {
+        size_t slash = spec.find('/');
+        if (!parseCpus(spec.substr(0, slash), sched.dataCpus))
+            return false;
+        if (std::string::npos==slash)
+            sched.netCpus = sched.dataCpus;
+        else if (!parseCpus(spec.substr(slash+1), sched.netCpus))
+            return false;
+    }
+    sched.configured = true;
+    return true;
+}
+
+// "fifo|rr|other[:<priority>]"
+bool parseSched(const std::string &spec, PumpSched &sched) {
+    size_t colon = spec.find(':');
+    std::string name = spec.substr(0, colon);
+    if ("fifo"==name)
+        sched.policy = SCHED_FIFO;
+    else if ("rr"==name)
+        sched.policy = SCHED_RR;
+    else if ("other"==name)
+        sched.policy = SCHED_OTHER;
+    else
+        return false;
+    sched.priority = std::string::npos==colon? sched_get_priority_min(sched.policy): atoi(spec.c_str()+colon+1);
+    if (sched.priority<sched_get_priority_min(sched.policy) || sched.priority>sched_get_priority_max(sched.policy))
+        return false;
+    sched.configured = true;
+    return true;
+}
+
+const char *schedName(int policy) {
+    return SCHED_FIFO==policy? "fifo": SCHED_RR==policy? "rr": "other";
+}
+
+// start a pump thread (fn(arg)) as placed, reporting (& running anyway without) what cannot be done,
+// id is the stream's data connection
+int startPump(pthread_t *tid, void *(*fn)(void *), void *arg, const PumpSched &sched, int id, const std::vector<int> &cpus, const char *what) {
+    SoapySDRLogLevel level = sched.configured? SOAPY_SDR_WARNING: SOAPY_SDR_DEBUG;
+    pthread_attr_t pat;
+    pthread_attr_init(&pat);
+    pthread_attr_setinheritsched(&pat, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&pat, sched.policy);
+    struct sched_param sch;
+    sch.sched_priority = sched.priority;
+    pthread_attr_setschedparam(&pat, &sch);
+    int err = pthread_create(tid, &pat, fn, arg);
+    pthread_attr_destroy(&pat);
+    bool normal = false;
+    if (EPERM==err) {
+        SoapySDR_logf(level, "setupStream: %d: %s pump: not permitted to use %s priority %d (needs CAP_SYS_NICE or RLIMIT_RTPRIO), running at normal priority",
+            id, what, schedName(sched.policy), sched.priority);
+        normal = true;
+        err = pthread_create(tid, nullptr, fn, arg);
+    }
+    if (err)
+        return err;
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu: cpus)
+            CPU_SET(cpu, &set);
+        int perr = pthread_setaffinity_np(*tid, sizeof(set), &set);
+        if (perr)
+            SoapySDR_logf(SOAPY_SDR_WARNING, "setupStream: %d: %s pump: unable to run on CPUs %s: %s",
+                id, what, cpuList(cpus).c_str(), strerror(perr));
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "setupStream: %d: %s pump: CPUs %s, %s priority %d", id, what,
+        cpuList(cpus).c_str(), normal? "other": schedName(sched.policy), normal? 0: sched.priority);
+    return 0;
+}
+
 static std::map<int, ConnectionInfo> s_connections;
+// guards the map (not the connections in it: each belongs to its RPC worker, or the main loop
+// for log streams). NB: never held across driver calls or thread joins.
+static std::recursive_mutex s_connMutex;
+// main loop, RPC & log connections are registered with it as they are created
+static SoapyReactor s_reactor;
+int handleRPC(int fd, uint32_t events, ConnectionInfo &conn);
+void closeLog(int fd);
+int internalStartPumps(ConnectionInfo &data);
+void notifyChange(ConnectionInfo &conn, const std::string &key);
+
+// look up a connection, nullptr if none
+ConnectionInfo *findConnection(int id) {
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    auto it = s_connections.find(id);
+    return it==s_connections.end()? nullptr: &it->second;
+}
+
+// look up one of our streams (data connection), nullptr if none
+ConnectionInfo *findStream(ConnectionInfo &conn, int dataId) {
+    if (conn.dataIds.find(dataId)==conn.dataIds.end())
+        return nullptr;
+    return findConnection(dataId);
+}
+
+void workerThread(RpcWorker *worker) {
+    std::unique_lock<std::mutex> lock(worker->mutex);
+    while (true) {
+        worker->cond.wait(lock, [worker]{ return worker->stop || !worker->tasks.empty(); });
+        if (worker->stop)
+            break;
+        std::function<void()> task = worker->tasks.front();
+        worker->tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+RpcWorker *newWorker() {
+    RpcWorker *worker = new RpcWorker();
+    worker->stop = false;
+    worker->dropped = false;
+    worker->thread = std::thread(workerThread, worker);
+    return worker;
+}
+
+void workerPost(RpcWorker *worker, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(task);
+    }
+    worker->cond.notify_one();
+}
+
+// main loop only, once the worker has nothing more to do (anything still queued is discarded)
+void endWorker(RpcWorker *worker) {
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->stop = true;
+    }
+    worker->cond.notify_one();
+    worker->thread.join();
+    delete worker;
+}
+
+// main loop: route readable events on an RPC connection to its worker
+void watchRpc(int sock, ConnectionInfo *ci) {
+    s_reactor.add(sock, [sock, ci](uint32_t events) {
+        RpcWorker *worker = ci->worker;
+        workerPost(worker, [sock, ci, worker, events] {
+            if (!worker->dropped && handleRPC(sock, events, *ci)<0)
+                s_reactor.post([]{ s_reactor.stop(4); });
+        });
+    });
+}
+
+// Relay mode: devices are opened on an upstream server (s_relayAddress), as its client with
+// the driver & args asked for plus s_relayArgs (client options, eg: tcpremote:session=true),
+// so its devices are served on to our clients. Our clients share them as any other, & their
+// receive streams share one upstream stream by default (tcpremote:fanout), so the upstream
+// carries each once. Setters are forwarded, unless our access upstream is observe, when they
+// are refused here.
+static std::string s_relayAddress;
+static SoapySDR::Kwargs s_relayArgs;
+
+SoapySDR::Kwargs relayKwargs(const SoapySDR::Kwargs &kwargs) {
+    SoapySDR::Kwargs up = s_relayArgs;
+    std::string args;
+    for (auto &kv: kwargs) {
+        if ("driver"==kv.first)
+            continue;
+        if (args.length()>0)
+            args += "/";
+        args += kv.first+"="+kv.second;
+    }
+    up["driver"] = "tcpremote";
+    up["tcpremote:address"] = s_relayAddress;
+    up["tcpremote:driver"] = kwargs.find("driver")!=kwargs.end()? kwargs.at("driver"): "";
+    up["tcpremote:args"] = args;
+    return up;
+}
+
+bool relayObserves() {
+    return s_relayAddress.length()>0 && s_relayArgs.find("tcpremote:access")!=s_relayArgs.end()
+        && "observe"==s_relayArgs.at("tcpremote:access");
+}
+
+// Devices released by their last client are kept open for s_cacheIdle secs (0 closes them
+// straight away), & preloaded ones until the server exits, so a client asking for the same
+// device (by its kwargs) again need not wait for the driver to open it. Idle devices are
+// closed by a thread of its own, as that can take as long as opening.
+struct CachedDevice
+{
+    SoapySDR::Device *dev;
+    bool keep;
+    std::chrono::steady_clock::time_point expires;
+};
+// guards the device cache & registry (below)
+static std::mutex s_deviceMutex;
+static std::condition_variable s_cacheCond;
+static std::multimap<std::string, CachedDevice> s_deviceCache;
+static long s_cacheIdle = 30;
 
-int createRpc(int sock) {
+// take a cached device, nullptr if none (call with s_deviceMutex held)
+SoapySDR::Device *cachedDevice(const std::string &key, bool &keep) {
+    auto it = s_deviceCache.find(key);
+    if (it==s_deviceCache.end())
+        return nullptr;
+    SoapySDR::Device *dev = it->second.dev;
+    keep = it->second.keep;
+    s_deviceCache.erase(it);
+    return dev;
+}
+
+// keep a released device open, false if it should be closed now (call with s_deviceMutex held)
+bool cacheDevice(const std::string &key, SoapySDR::Device *dev, bool keep) {
+    if (!keep && s_cacheIdle<=0)
+        return false;
+    CachedDevice cd = { dev, keep, std::chrono::steady_clock::now()+std::chrono::seconds(s_cacheIdle) };
+    s_deviceCache.insert(std::make_pair(key, cd));
+    s_cacheCond.notify_one();
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "cacheDevice: keeping open: %s", key.c_str());
+    return true;
+}
+
+void cacheThread() {
+    std::unique_lock<std::mutex> lock(s_deviceMutex);
+    while (true) {
+        // close anything idle for long enough (without the lock), then wait for the next
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        std::vector<std::pair<std::string, SoapySDR::Device *>> idle;
+        for (auto it = s_deviceCache.begin(); it!=s_deviceCache.end();) {
+            if (!it->second.keep && it->second.expires<=now) {
+                idle.push_back(std::make_pair(it->first, it->second.dev));
+                it = s_deviceCache.erase(it);
+                continue;
+            }
+            if (!it->second.keep && it->second.expires<next)
+                next = it->second.expires;
+            ++it;
+        }
+        if (!idle.empty()) {
+            lock.unlock();
+            for (auto &it: idle) {
+                SoapySDR_logf(SOAPY_SDR_INFO, "Closing idle device: %s", it.first.c_str());
+                SoapySDR::Device::unmake(it.second);
+            }
+            lock.lock();
+            continue;
+        }
+        if (next==std::chrono::steady_clock::time_point::max())
+            s_cacheCond.wait(lock);
+        else
+            s_cacheCond.wait_until(lock, next);
+    }
+}
+
+// open a device at startup, & keep it
+void preloadDevice(const std::string &args) {
+    SoapySDR::Kwargs kwargs = SoapySDR::KwargsFromString(args);
+    SoapySDR::Device *dev = nullptr;
+    try {
+        dev = SoapySDR::Device::make(s_relayAddress.empty()? kwargs: relayKwargs(kwargs));
+    } catch(const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"exception from Device::make(): %s", ex.what());
+    }
+    if (!dev) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "failed to preload device: %s", args.c_str());
+        return;
+    }
+    std::string key = SoapySDR::KwargsToString(kwargs);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Preloaded device: %s", key.c_str());
+    std::lock_guard<std::mutex> lock(s_deviceMutex);
+    cacheDevice(key, dev, true);
+}
+
+// Clients asking for the same device (by its kwargs) share it: the first to attach opens it (or
+// takes it from the cache), the last to detach releases it, & driver calls from their RPCs take
+// turns. Each client's access is shared (the default: may change settings unless another client
+// has control), control (as shared, & no other client may change settings) or observe (may not
+// change settings). Changes reach every other client's log stream via notifyChange().
+enum { ACCESS_SHARED, ACCESS_CONTROL, ACCESS_OBSERVE };
+
+struct SharedDevice
+{
+    SharedDevice(): dev(nullptr), refs(0), keep(false), controller(nullptr) {}
+    // nullptr while being opened or closed
+    SoapySDR::Device *dev;
+    int refs;
+    bool keep;
+    // the client in control, if any
+    ConnectionInfo *controller;
+    // held by its clients' RPCs
+    std::mutex rpcMutex;
+    // shared receive streams, by channel list (guarded by rpcMutex)
+    std::map<std::string, StreamFanout *> fanouts;
+};
+static std::condition_variable s_openCond;
+static std::map<std::string, SharedDevice> s_devices;
+
+// the shared device for key, opened with kwargs if no client has it, nullptr on failure
+SharedDevice *attachDevice(const std::string &key, const SoapySDR::Kwargs &kwargs) {
+    std::unique_lock<std::mutex> lock(s_deviceMutex);
+    auto it = s_devices.find(key);
+    // another client is opening or closing it, wait for that
+    while (it!=s_devices.end() && !it->second.dev) {
+        s_openCond.wait(lock);
+        it = s_devices.find(key);
+    }
+    if (it!=s_devices.end()) {
+        ++it->second.refs;
+        SoapySDR_logf(SOAPY_SDR_INFO, "Sharing open device: %s (%d clients)", key.c_str(), it->second.refs);
+        return &it->second;
+    }
+    SharedDevice &sd = s_devices[key];
+    sd.refs = 1;
+    sd.dev = cachedDevice(key, sd.keep);
+    if (sd.dev) {
+        SoapySDR_logf(SOAPY_SDR_INFO, "Using open device: %s", key.c_str());
+        return &sd;
+    }
+    // make it without the lock, others asking for it wait
+    lock.unlock();
+    SoapySDR::Device *dev = nullptr;
+    try {
+        dev = SoapySDR::Device::make(s_relayAddress.empty()? kwargs: relayKwargs(kwargs));
+    } catch(const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"exception from Device::make(): %s", ex.what());
+    }
+    lock.lock();
+    s_openCond.notify_all();
+    if (!dev) {
+        s_devices.erase(key);
+        return nullptr;
+    }
+    sd.dev = dev;
+    return &sd;
+}
+
+// let go of our shared device, the last client releases it to the cache (or closes it)
+void detachDevice(ConnectionInfo &conn) {
+    SoapySDR::Device *dev;
+    {
+        std::lock_guard<std::mutex> lock(s_deviceMutex);
+        SharedDevice *sd = conn.shared;
+        if (sd->controller==&conn)
+            sd->controller = nullptr;
+        if (--sd->refs>0)
+            return;
+        dev = sd->dev;
+        if (cacheDevice(conn.devKey, dev, sd->keep)) {
+            s_devices.erase(conn.devKey);
+            return;
+        }
+        // closing, others asking for it wait
+        sd->dev = nullptr;
+    }
+    SoapySDR::Device::unmake(dev);
+    std::lock_guard<std::mutex> lock(s_deviceMutex);
+    s_devices.erase(conn.devKey);
+    s_openCond.notify_all();
+}
+
+// may this client change settings of its device, else why not
+bool mayControl(ConnectionInfo &conn, const char *&why) {
+    if (ACCESS_OBSERVE==conn.access) {
+        why = "observer access";
+        return false;
+    }
+    if (relayObserves()) {
+        why = "relay only observes upstream device";
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(s_deviceMutex);
+    if (conn.shared->controller && conn.shared->controller!=&conn) {
+        why = "another client has control";
+        return false;
+    }
+    return true;
+}
+
+// runs on the new connection's worker
+int createRpc(int sock, RpcWorker *worker) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "createRpc()");
     ConnectionInfo conn;
     conn.rpc = new SoapyRPC(sock);
+    conn.worker = worker;
     conn.log = nullptr;     // ensure we aren't treated as LOG stream
     // read driver and args..
     SoapySDR::Kwargs kwargs;
@@ -195,23 +850,28 @@ int createRpc(int sock) {
             kwargs[arg.substr(0,off)]=arg.substr(off+1);
         }
     } while (nxt != std::string::npos);
-    // make the device
-    try {
-        conn.dev = SoapySDR::Device::make(kwargs);
-    } catch(const std::exception &ex) {
-        conn.dev = nullptr;
-        SoapySDR_logf(SOAPY_SDR_ERROR,"exception from Device::make(): %s", ex.what());
-    }
-    if (!conn.dev) {
+    // share an open device, or open one
+    conn.devKey = SoapySDR::KwargsToString(kwargs);
+    conn.shared = attachDevice(conn.devKey, kwargs);
+    if (!conn.shared) {
         // oops - report failure to client and drop connection
         SoapySDR_logf(SOAPY_SDR_ERROR,"failed to create SoapySDR::Device: %s", kwargs["driver"].c_str());
         conn.rpc->writeInteger(-1);
         delete conn.rpc;
+        s_reactor.post([worker]{ endWorker(worker); });
         return 0;
     }
-    // all good - add to map and respond with map key
-    s_connections[sock] = conn;
+    conn.dev = conn.shared->dev;
+    // all good - add to map, watch for requests and respond with map key
+    ConnectionInfo *ci;
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        s_connections[sock] = conn;
+        ci = &s_connections[sock];
+    }
+    s_reactor.post([sock, ci]{ watchRpc(sock, ci); });
     conn.rpc->writeInteger(sock);
+    conn.rpc->flush();
     SoapySDR_logf(SOAPY_SDR_INFO, "New RPC connection: %d", sock);
     return 0;
 }
@@ -222,9 +882,13 @@ int createData(int sock, int type) {
     conn.rpc = nullptr;     // ensure we aren't treated as RPC stream
     conn.log = nullptr;     // ensure we aren't treated as LOG stream
     conn.netSock = sock;
+    conn.framed = TCPREMOTE_DATA_SEND_BLOCKS==type;
     // all good - add to map and respond with map key
     // NB: we write to raw socket as stdio stream may be read-only..
-    s_connections[sock] = conn;
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        s_connections[sock] = conn;
+    }
     char id[10];
     int ilen = sprintf(id,"%d\n",sock);
     write(sock, id, ilen);
@@ -234,6 +898,40 @@ int createData(int sock, int type) {
 
 static SoapySDRLogLevel s_defaultLogLevel;
 
+// most output held for a slow log stream, before we drop lines
+const size_t LOG_BACKLOG_MAX = 65536;
+
+// send what we can of a log stream's backlog, without blocking (s_connMutex held)
+void logFlush(ConnectionInfo &ci) {
+    while (!ci.logBacklog.empty()) {
+        ssize_t n = send(ci.netSock, ci.logBacklog.data(), ci.logBacklog.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n<=0)
+            break;
+        ci.logBacklog.erase(0, n);
+    }
+}
+
+// send a line to a log stream (with s_connMutex held, so from anywhere), what the socket will
+// not take yet is held until it will, lines that don't fit in that backlog are dropped
+void logSend(ConnectionInfo &ci, const std::string &line) {
+    if (ci.logDropped>0 && ci.logBacklog.size()+line.size()+64<=LOG_BACKLOG_MAX) {
+        ci.logBacklog += std::to_string(SOAPY_SDR_WARNING)+":log stream overrun, "+std::to_string(ci.logDropped)+" lines dropped\n";
+        ci.logDropped = 0;
+    }
+    if (0==ci.logDropped && ci.logBacklog.size()+line.size()<=LOG_BACKLOG_MAX)
+        ci.logBacklog += line;
+    else
+        ++ci.logDropped;
+    logFlush(ci);
+}
+
+void flushLog(int fd) {
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    auto it = s_connections.find(fd);
+    if (it!=s_connections.end() && it->second.log)
+        logFlush(it->second);
+}
+
 int createLog(int sock) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "createLog()");
     ConnectionInfo conn;
@@ -251,77 +949,768 @@ int createLog(int sock) {
     }
     sscanf(buf, "%d", (int*)&level);
     conn.level = (SoapySDRLogLevel)level;
-    s_connections[sock] = conn;
-    fprintf(conn.log, "%d\n", sock);    // write our id (map key)
+    {
+        // write our id (map key) first, before any other output
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        s_connections[sock] = conn;
+        logSend(s_connections[sock], std::to_string(sock)+"\n");
+    }
+    // any input or error on log stream means we're done, room to write sends any backlog
+    s_reactor.add(sock, [sock](uint32_t events) {
+        if (events & ~EPOLLOUT)
+            closeLog(sock);
+        else
+            flushLog(sock);
+    }, EPOLLIN | EPOLLOUT);
     SoapySDR_logf(SOAPY_SDR_INFO, "New log connection: %d @ %d", sock, level);
     return 0;
 }
 
+// link probe: send zeros as fast as we can for the requested time, then close.
+// runs on its own thread so we don't stall the main loop.
+void *probePump(void *ctx) {
+    int sock = (int)(intptr_t)ctx;
+    FILE *fp = fdopen(sock, "r+");
+    char buf[10];
+    if (!fp || !fgets(buf, sizeof(buf), fp)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "probePump: failed to read duration: %s", strerror(errno));
+        if (fp) fclose(fp); else close(sock);
+        return nullptr;
+    }
+    long msecs = atol(buf);
+    // keep it sane, 10 secs max
+    if (msecs<=0 || msecs>10000)
+        msecs = 1000;
+    std::vector<uint8_t> zeros(65536);
+    struct timespec t0, ts;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long long total = 0;
+    do {
+        ssize_t n = send(sock, zeros.data(), zeros.size(), MSG_NOSIGNAL);
+        if (n<=0)
+            break;
+        total += n;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    } while ((ts.tv_sec-t0.tv_sec)*1000 + (ts.tv_nsec-t0.tv_nsec)/1000000 < msecs);
+    fclose(fp);
+    SoapySDR_logf(SOAPY_SDR_INFO, "Link probe complete: %d, %lld bytes", sock, total);
+    return nullptr;
+}
+
+int createProbe(int sock) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "createProbe()");
+    pthread_t pid;
+    if (pthread_create(&pid, nullptr, probePump, (void *)(intptr_t)sock)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "createProbe: failed to create probe thread: %s", strerror(errno));
+        close(sock);
+        return 0;
+    }
+    pthread_detach(pid);
+    SoapySDR_logf(SOAPY_SDR_INFO, "New link probe: %d", sock);
+    return 0;
+}
+
+// our clock for stream & clock sync timestamps (nsecs)
+long long realtimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+// time of the first of nread samples just read: the driver's, or ours backdated by the sample rate
+StreamMark timeMark(double rate, uint64_t at, int flags, long long timeNs, int nread) {
+    StreamMark mark = { at, StreamMark::TIME, { 0, 0, 0 }, timeNs, false };
+    if (!(flags & SOAPY_SDR_HAS_TIME)) {
+        mark.timeNs = realtimeNs();
+        if (rate>0)
+            mark.timeNs -= (long long)(nread*1e9/rate);
+        mark.host = true;
+    }
+    return mark;
+}
+
 // uSec difference between timespec samples
 long tsdiff(struct timespec *t1, struct timespec *t2) {
     long r = (t2->tv_sec-t1->tv_sec)*1000000;
     r += (t2->tv_nsec-t1->tv_nsec)/1000;
     return r;
 }
-void *netPump(void *ctx) {
-    ConnectionInfo *conn = (ConnectionInfo *)ctx;
-    // you had 1 job... read that pipe and stuff down network
-    size_t elemSize = g_frameSizes.at(conn->format)*conn->channels.size();
+
+// clock sync: for each request line, reply with our clock when it arrived & as we reply
+// ("<recv> <send>\n", nsecs), so the client can estimate offset & round trip time (NTP
+// style). Runs on its own thread so main loop stalls don't add to the round trip.
+void *clockPump(void *ctx) {
+    int sock = (int)(intptr_t)ctx;
+    char buf[64];
+    ssize_t n;
+    while ((n=read(sock, buf, sizeof(buf)))>0) {
+        long long recv = realtimeNs();
+        char rep[48];
+        int rlen = sprintf(rep, "%lld ", recv);
+        rlen += sprintf(rep+rlen, "%lld\n", realtimeNs());
+        if (write(sock, rep, rlen)!=rlen)
+            break;
+    }
+    close(sock);
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "clockPump: stop: %d", sock);
+    return nullptr;
+}
+
+int createClock(int sock) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "createClock()");
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    pthread_t pid;
+    if (pthread_create(&pid, nullptr, clockPump, (void *)(intptr_t)sock)) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "createClock: failed to create clock thread: %s", strerror(errno));
+        close(sock);
+        return 0;
+    }
+    pthread_detach(pid);
+    SoapySDR_logf(SOAPY_SDR_INFO, "New clock sync: %d", sock);
+    return 0;
+}
+// Uplink bandwidth: receive streams share a budget (--budget, 0 unlimited) by weight
+// (tcpremote:weight, default 1), within caps per stream (tcpremote:max_rate) & per client
+// (--client-cap), all bytes/sec here. Each stream commits the least it can do with (its rate at
+// its narrowest wire format, see tcpremote:adapt, within its caps) as it is set up & again as it
+// activates, refused if the total committed would exceed the budget. Active streams are paced
+// to their share, of what they want (their rate at the stream format & a quarter, to catch up
+// after a stall): by the kernel (SO_MAX_PACING_RATE) on a TCP data connection if --pacing socket
+// (default), else by a token bucket in writeBlock(). So no stream takes more than its share of
+// the uplink, or sends it in bursts, & those given less than their rate adapt to it. Without a
+// budget or caps nothing is paced.
+struct StreamShare
+{
+    // the client (RPC connection) & its data connection
+    ConnectionInfo *client, *data;
+    // rate at the stream format & narrowest wire format (0 unknown), cap (0 none) & weight
+    double rate, least, cap, weight;
+    bool active;
+};
+
+enum { PACING_SOCKET, PACING_BUCKET };
+static std::mutex s_shareMutex;
+static std::map<int, StreamShare> s_shares;
+static double s_budget = 0, s_clientCap = 0;
+static int s_pacing = PACING_SOCKET;
+
+// what an active stream wants: its rate & a quarter, within its cap (HUGE_VAL unknown & uncapped,
+// or unlimited if the server is), & the least it gets: what it committed
+double shareWant(const StreamShare &sh) {
+    double want = sh.rate>0 && (s_budget>0 || s_clientCap>0)? sh.rate*1.25: HUGE_VAL;
+    return sh.cap>0 && sh.cap<want? sh.cap: want;
+}
+
+double shareFloor(const StreamShare &sh) {
+    return sh.cap>0 && sh.cap<sh.least? sh.cap: sh.least;
+}
+
+// total committed, each client's streams within its cap (with s_shareMutex held)
+double committedBandwidth() {
+    std::map<ConnectionInfo *, double> clients;
+    for (auto &it: s_shares) {
+        clients[it.second.client] += shareFloor(it.second);
+    }
+    double total = 0;
+    for (auto &it: clients)
+        total += s_clientCap>0 && s_clientCap<it.second? s_clientCap: it.second;
+    return total;
+}
+
+// weighted max-min fair shares of capacity (HUGE_VAL unlimited) over floors: each gets its floor
+// (all get less, in proportion, if capacity does not cover them), then those wanting less than
+// their share of the rest get what they want, & what they leave is shared among the others
+std::vector<double> fairShares(const std::vector<double> &want, const std::vector<double> &floor, const std::vector<double> &weight, double capacity) {
+    std::vector<double> share(floor);
+    double floors = 0;
+    for (double f: floor)
+        floors += f;
+    if (capacity<floors) {
+        for (double &s: share)
+            s *= capacity/floors;
+        return share;
+    }
+    capacity -= floors;
+    std::vector<bool> done(want.size(), false);
+    size_t left = want.size();
+    while (left>0) {
+        double weights = 0;
+        for (size_t idx=0; idx<want.size(); ++idx) {
+            if (!done[idx])
+                weights += weight[idx];
+        }
+        double unit = capacity/weights;
+        bool settled = false;
+        for (size_t idx=0; idx<want.size(); ++idx) {
+            if (!done[idx] && want[idx]-floor[idx]<=unit*weight[idx]) {
+                share[idx] = want[idx];
+                capacity -= want[idx]-floor[idx];
+                done[idx] = true;
+                settled = true;
+                --left;
+            }
+        }
+        if (!settled) {
+            for (size_t idx=0; idx<want.size(); ++idx) {
+                if (!done[idx])
+                    share[idx] += unit*weight[idx];
+            }
+            break;
+        }
+    }
+    return share;
+}
+
+// pace a stream to rate (HUGE_VAL unpaced): by the kernel where asked & it can (a lone TCP
+// connection, not striped or in a session), else by our token bucket
+void paceStream(ConnectionInfo &data, double rate) {
+    bool paced = rate<HUGE_VAL;
+    bool kernel = false;
+    if (PACING_SOCKET==s_pacing && data.stripes.empty()) {
+        struct sockaddr_storage addr;
+        socklen_t alen = sizeof(addr);
+        unsigned int bps = paced && rate<4e9? (unsigned int)rate: ~0U;
+        kernel = getsockname(data.netSock, (struct sockaddr *)&addr, &alen)==0
+            && (AF_INET==addr.ss_family || AF_INET6==addr.ss_family)
+            && setsockopt(data.netSock, SOL_SOCKET, SO_MAX_PACING_RATE, &bps, sizeof(bps))==0;
+    }
+    double was = data.paceRate;
+    data.paceKernel = kernel;
+    data.paceRate = paced? rate: 0;
+    if (data.paceRate!=was)
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "bandwidth: %d: paced to %.1f Mbit/s (%s)", data.netSock,
+            data.paceRate*8/1e6, !paced? "unpaced": kernel? "socket": "bucket");
+}
+
+// share the budget between active streams, clients first then each client's streams, & pace
+// them (with s_shareMutex held)
+void scheduleBandwidth() {
+    std::map<ConnectionInfo *, std::vector<StreamShare *>> clients;
+    for (auto &it: s_shares) {
+        if (it.second.active)
+            clients[it.second.client].push_back(&it.second);
+    }
+    std::vector<double> want, floor, weight;
+    for (auto &it: clients) {
+        double cw = 0, cf = 0, cwt = 0;
+        for (StreamShare *sh: it.second) {
+            cw += shareWant(*sh);
+            cf += shareFloor(*sh);
+            cwt += sh->weight;
+        }
+        want.push_back(s_clientCap>0 && s_clientCap<cw? s_clientCap: cw);
+        floor.push_back(s_clientCap>0 && s_clientCap<cf? s_clientCap: cf);
+        weight.push_back(cwt);
+    }
+    std::vector<double> cshare = fairShares(want, floor, weight, s_budget>0? s_budget: HUGE_VAL);
+    size_t cidx = 0;
+    for (auto &it: clients) {
+        want.clear();
+        floor.clear();
+        weight.clear();
+        for (StreamShare *sh: it.second) {
+            want.push_back(shareWant(*sh));
+            floor.push_back(shareFloor(*sh));
+            weight.push_back(sh->weight);
+        }
+        std::vector<double> share = fairShares(want, floor, weight, cshare[cidx++]);
+        for (size_t idx=0; idx<share.size(); ++idx)
+            paceStream(*it.second[idx]->data, share[idx]);
+    }
+}
+
+// commit a receive stream's rate as it is set up (inactive) or activates (cap & weight <0 keep
+// those it was set up with), false (leaving it as it was) if that would exceed the budget
+bool commitShare(ConnectionInfo &client, ConnectionInfo &data, double cap, double weight, bool active, const char *what) {
+    double rate = data.dev->getSampleRate(SOAPY_SDR_RX, data.channels.at(0));
+    rate = rate>0? rate*data.channels.size(): 0;
+    double least = rate*formatSize(data.wireLevels[0].format);
+    for (auto &l: data.wireLevels) {
+        if (rate*formatSize(l.format)/l.decim<least)
+            least = rate*formatSize(l.format)/l.decim;
+    }
+    rate *= formatSize(data.wireLevels[0].format);
+    std::lock_guard<std::mutex> lock(s_shareMutex);
+    auto it = s_shares.find(data.netSock);
+    bool had = it!=s_shares.end();
+    StreamShare old;
+    if (had)
+        old = it->second;
+    StreamShare &sh = s_shares[data.netSock];
+    sh.client = &client;
+    sh.data = &data;
+    sh.rate = rate;
+    sh.least = least;
+    sh.cap = had && cap<0? old.cap: cap;
+    sh.weight = had && weight<0? old.weight: weight;
+    sh.active = active;
+    double total = committedBandwidth();
+    if (s_budget>0 && total>s_budget) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "%s: %d: %.1f Mbit/s refused, would commit %.1f of the %.1f Mbit/s budget",
+            what, data.netSock, least*8/1e6, total*8/1e6, s_budget*8/1e6);
+        if (had)
+            sh = old;
+        else
+            s_shares.erase(data.netSock);
+        return false;
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "%s: %d: %.1f Mbit/s committed, %.1f Mbit/s in all", what, data.netSock, least*8/1e6, total*8/1e6);
+    if (active)
+        scheduleBandwidth();
+    return true;
+}
+
+// a stream stops (idle, still committed) or closes (released)
+void idleShare(ConnectionInfo &data, bool release) {
+    std::lock_guard<std::mutex> lock(s_shareMutex);
+    auto it = s_shares.find(data.netSock);
+    if (it==s_shares.end())
+        return;
+    bool was = it->second.active;
+    if (release)
+        s_shares.erase(it);
+    else
+        it->second.active = false;
+    if (was)
+        scheduleBandwidth();
+}
+
+// hold a block back until the stream's paced rate allows it, by token bucket (bursting up to
+// 5 msecs' worth, or a block), or if dontwait drop it (returns false)
+bool paceBlock(ConnectionInfo *conn, size_t len, bool dontwait) {
+    double rate = conn->paceRate;
+    if (rate<=0 || conn->paceKernel)
+        return true;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double burst = rate*0.005>len? rate*0.005: len;
+    conn->paceTokens += tsdiff(&conn->paceLast, &now)*rate/1e6;
+    if (conn->paceTokens>burst)
+        conn->paceTokens = burst;
+    conn->paceLast = now;
+    if (conn->paceTokens<len && dontwait)
+        return false;
+    conn->paceTokens -= len;
+    if (conn->paceTokens<0)
+        usleep((useconds_t)(-conn->paceTokens*1e6/rate));
+    return true;
+}
+
+// unsent bytes & send buffer size, across all data connections of a stream
+bool sendQueued(ConnectionInfo *conn, int &outq, int &sndbuf) {
+    outq = sndbuf = 0;
+    for (size_t idx=0; idx<=conn->stripes.size(); ++idx) {
+        int sock = idx? conn->stripes[idx-1]: conn->netSock;
+        int q, b;
+        socklen_t slen = sizeof(b);
+        if (ioctl(sock, SIOCOUTQ, &q)<0 || getsockopt(sock, SOL_SOCKET, SO_SNDBUF, &b, &slen)<0)
+            return false;
+        outq += q;
+        sndbuf += b;
+    }
+    return sndbuf>0;
+}
+
+// the data connection for the next block: ours, or of a striped stream the one with the
+// least unsent, which steers blocks away from any flow held up recovering lost packets
+int blockSock(ConnectionInfo *conn) {
+    int sock = conn->netSock, least;
+    if (conn->stripes.empty() || ioctl(sock, SIOCOUTQ, &least)<0)
+        return sock;
+    for (int s: conn->stripes) {
+        int outq;
+        if (ioctl(s, SIOCOUTQ, &outq)==0 && outq<least) {
+            least = outq;
+            sock = s;
+        }
+    }
+    return sock;
+}
+
+// write a data block (header + payload) in one syscall where possible, once pacing
+// allows. If dontwait is set and nothing could be written (or pacing holds it back),
+// the block is dropped (returns 0), otherwise any partial write is completed to
+// preserve framing. Unframed streams get only the payload of sample blocks.
+int writeBlock(ConnectionInfo *conn, const TCPRemoteLevel &lvl, const void *data, size_t len, bool dontwait = false, uint32_t flags = 0, long long timeNs = 0) {
+    TCPRemoteBlock blk;
+    blk.magic = TCPREMOTE_BLOCK_MAGIC;
+    blk.format = lvl.format;
+    blk.decim = lvl.decim;
+    blk.flags = flags;
+    blk.seq = conn->seq++;
+    blk.length = len;
+    blk.timeNs = timeNs;
+    struct iovec iov[2];
+    iov[0].iov_base = &blk;
+    iov[0].iov_len = sizeof(blk);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (!conn->framed) {
+        if (0==len || (flags & TCPREMOTE_BLOCK_DWELL))
+            return (int)len;
+        ++msg.msg_iov;
+        --msg.msg_iovlen;
+    }
+    if (!paceBlock(conn, (conn->framed? sizeof(blk): 0)+len, dontwait))
+        return 0;
+    int sock = blockSock(conn);
+    ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL | (dontwait? MSG_DONTWAIT: 0));
+    if (n<0 && dontwait && (EAGAIN==errno || EWOULDBLOCK==errno))
+        return 0;
+    while (n>=0) {
+        // skip what has been written, finish the rest
+        while (msg.msg_iovlen>0 && (size_t)n>=msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            ++msg.msg_iov;
+            --msg.msg_iovlen;
+        }
+        if (0==msg.msg_iovlen)
+            return (int)len;
+        msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + n;
+        msg.msg_iov->iov_len -= n;
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    }
+    return -1;
+}
+
+// Congestion adaptation: sample the unsent queue on the data socket(s) (and our own
+// backlog %, of the pipe or shared ring, which fills when the socket is blocked), step
+// down the wire format ladder when either exceeds adaptHigh %, step back up once both
+// have stayed below adaptLow % for adaptHold msecs.
+void adaptWireLevel(ConnectionInfo *conn, int backlog, struct timespec *now, struct timespec *lchg, struct timespec *lbusy) {
+    if (conn->wireLevels.size()<2)
+        return;
+    int outq, sndbuf;
+    if (!sendQueued(conn, outq, sndbuf))
+        return;
+    int pct = (int)((long)outq*100/sndbuf);
+    if (backlog>pct)
+        pct = backlog;
+    if (pct>=conn->adaptLow)
+        *lbusy = *now;
+    size_t lvl = conn->wireLevel;
+    // step down at most once per quarter hold time, to let the queue drain
+    if (pct>=conn->adaptHigh && lvl+1<conn->wireLevels.size() && tsdiff(lchg, now)>=conn->adaptHold*250L)
+        ++lvl;
+    else if (lvl>0 && tsdiff(lbusy, now)>=conn->adaptHold*1000L && tsdiff(lchg, now)>=conn->adaptHold*1000L)
+        --lvl;
+    if (lvl!=conn->wireLevel) {
+        const TCPRemoteLevel &from = conn->wireLevels[conn->wireLevel];
+        const TCPRemoteLevel &to = conn->wireLevels[lvl];
+        SoapySDR_logf(SOAPY_SDR_INFO, "netPump: %d: queued %d%%, wire format %s/%d -> %s/%d",
+            conn->netSock, pct, formatName(from.format), from.decim, formatName(to.format), to.decim);
+        conn->wireLevel = lvl;
+        *lchg = *now;
+    }
+}
+
+// log how long the latest activation took, once its first samples are sent
+void firstSent(ConnectionInfo *conn) {
+    StreamPumps *pumps = conn->pumps;
+    if (pumps->sent)
+        return;
+    pumps->sent = true;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "activateStream: %d: active after %ld usecs, first samples sent after %ld usecs",
+        conn->netSock, pumps->activeUs, tsdiff(&pumps->asked, &ts));
+}
+
+// elements netPump handles at a time
+size_t netPumpElems(size_t elemSize) {
     size_t numElems = BUFSIZ/elemSize;
-    uint8_t wrbuf[numElems*elemSize];
+    // leave room for the largest decimation remainder
+    if (numElems<256)
+        numElems = 256;
+    return numElems;
+}
+
+// one activation's worth of network pumping, until dataPump stops or a burst ends
+void netPump(ConnectionInfo *conn) {
+    // you had 1 job... read that pipe and stuff down network
+    size_t numChans = conn->channels.size();
+    size_t elemSize = g_frameSizes.at(conn->format)*numChans;
+    size_t numElems = conn->pumps->netElems;
+    uint8_t *wrbuf = (uint8_t *)conn->pumps->netMem.data();
+    // converted output, levels are never wider than the stream format
+    uint8_t *cvbuf = wrbuf+numElems*elemSize;
+    size_t carry = 0;
     int nrd;
     SoapySDR_logf(SOAPY_SDR_DEBUG, "netPump: start: %d", conn->netSock);
-    struct timespec lt;
+    struct timespec lt, lchk, lchg, lbusy;
     clock_gettime(CLOCK_MONOTONIC, &lt);
+    lchk = lchg = lbusy = lt;
     // ignore SIGPIPE, so we get EPIPE returned
     signal(SIGPIPE, SIG_IGN);
-    while ((nrd=piperead(wrbuf, elemSize, numElems, conn->netPipe))>0 && conn->pid!=0) {
-        if (nullptr==getenv("INHIBIT_WRITE") &&
-            write(conn->netSock, wrbuf, elemSize*nrd)!=(int)elemSize*nrd) {
+    // elements read from the pipe, to place stream marks, & the latest TIME mark
+    uint64_t pos = 0;
+    StreamMark anchor = { 0, StreamMark::TIME, { 0, 0, 0 }, 0, false };
+    bool timed = false;
+    bool failed = false, last = false;
+    while (!last && (nrd=piperead(wrbuf+carry*elemSize, elemSize, numElems-carry, conn->netPipe))>0 && conn->running) {
+        const TCPRemoteLevel &lvl = conn->wireLevels[conn->wireLevel];
+        size_t have = carry+nrd;
+        uint64_t base = pos-carry;
+        pos += nrd;
+        carry = 0;
+        // send what we have, split into blocks at any stream marks
+        size_t off = 0;
+        do {
+            StreamMark mark;
+            bool marked;
+            // TIME marks don't split blocks, the block start is timed from the latest
+            while ((marked = takeMark(conn, base+have, mark)) && StreamMark::TIME==mark.kind) {
+                anchor = mark;
+                timed = true;
+            }
+            size_t end = marked && mark.at>base+off? (size_t)(mark.at-base): marked? off: have;
+            const void *out = wrbuf+off*elemSize;
+            size_t olen = (end-off)*elemSize;
+            if (conn->wireLevel>0) {
+                // narrow and/or decimate, keeping any partial decimation for next time (within a dwell)
+                size_t nout = convertSamples(cvbuf, lvl.format, out, conn->wireLevels[0].format, end-off, numChans, lvl.decim);
+                if (!marked) {
+                    carry = end-off - nout*lvl.decim;
+                    memmove(wrbuf, wrbuf+(end-carry)*elemSize, carry*elemSize);
+                }
+                out = cvbuf;
+                olen = nout*formatSize(lvl.format)*numChans;
+            }
+            // ends of dwells & bursts are flagged, even if that leaves an empty block
+            uint32_t flags = marked && mark.kind!=StreamMark::DWELL? SOAPY_SDR_END_BURST: 0;
+            long long timeNs = 0;
+            if (timed && olen>0) {
+                flags |= SOAPY_SDR_HAS_TIME | (anchor.host? TCPREMOTE_BLOCK_HOSTTIME: 0);
+                timeNs = anchor.timeNs;
+                if (conn->sampleRate>0)
+                    timeNs += (long long)(((double)(base+off)-(double)anchor.at)*1e9/conn->sampleRate);
+            }
+            if ((olen>0 || flags) && nullptr==getenv("INHIBIT_WRITE") && writeBlock(conn, lvl, out, olen, false, flags, timeNs)<0)
+                failed = true;
+            else if (olen>0)
+                firstSent(conn);
+            // announce the next dwell ahead of its samples
+            if (!failed && marked && StreamMark::DWELL==mark.kind && writeBlock(conn, lvl, &mark.dwell, sizeof(mark.dwell), false, TCPREMOTE_BLOCK_DWELL)<0)
+                failed = true;
+            // nothing more after the end of a burst
+            last = marked && StreamMark::LAST==mark.kind;
+            off = last? have: end;
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            SoapySDR_logf(SOAPY_SDR_TRACE, "%ld: netPump: write: %d<=%d",
+                tsdiff(&lt, &ts), conn->netSock, (int)olen);
+            lt = ts;
+        } while (!failed && off<have);
+        if (failed) {
             SoapySDR_logf(SOAPY_SDR_ERROR, "netPump: unable to write to network: %s", strerror(errno));
             break;
         }
         struct timespec ts;
         clock_gettime(CLOCK_MONOTONIC, &ts);
-        SoapySDR_logf(SOAPY_SDR_TRACE, "%ld: netPump: write: %d<=%d",
-            tsdiff(&lt, &ts), conn->netSock, nrd*elemSize);
-        lt = ts;
+        // check for congestion every 50msecs
+        if (tsdiff(&lchk, &ts)>=50000) {
+            lchk = ts;
+            adaptWireLevel(conn, pipeused(conn->netPipe), &ts, &lchg, &lbusy);
+        }
     }
     SoapySDR_logf(SOAPY_SDR_DEBUG, "netPump: stop: %d", conn->netSock);
-    return nullptr;
 }
 
-void *dataPump(void *ctx) {
-    ConnectionInfo *conn = (ConnectionInfo *)ctx;
+// one activation's worth of sending from a shared stream's ring, until deactivated
+void fanoutPump(ConnectionInfo *conn) {
+    StreamFanout *f = conn->fanout;
+    size_t numChans = f->channels.size();
+    size_t elemSize = f->elemSize;
+    size_t numElems = conn->pumps->netElems;
+    uint8_t *ring = (uint8_t *)f->mem.data();
+    uint8_t *wrbuf = (uint8_t *)conn->pumps->netMem.data();
+    // converted output, to our own format & any wire level
+    uint8_t *cvbuf = wrbuf+numElems*elemSize;
+    size_t carry = 0;
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "fanoutPump: start: %d", conn->netSock);
+    struct timespec lchk, lchg, lbusy;
+    clock_gettime(CLOCK_MONOTONIC, &lchk);
+    lchg = lbusy = lchk;
+    signal(SIGPIPE, SIG_IGN);
+    // from the latest samples
+    uint64_t cursor = f->head.load();
+    while (conn->running) {
+        uint64_t head;
+        {
+            std::unique_lock<std::mutex> lock(f->mutex);
+            f->cond.wait_for(lock, std::chrono::milliseconds(100), [conn, f, cursor]{ return !conn->running || f->head.load()>cursor; });
+            head = f->head.load();
+        }
+        if (!conn->running)
+            break;
+        if (head<=cursor)
+            continue;
+        // a ring behind (or as good as, with a read in progress): skip to half way
+        if (head-cursor+f->readElems>f->ringElems) {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "fanoutPump: %d: overrun shared stream, data loss", conn->netSock);
+            cursor = head-f->ringElems/2;
+            carry = 0;
+        }
+        // copy out what we can (around the end of the ring), then check it was not overwritten meanwhile
+        size_t nrd = head-cursor;
+        if (nrd>numElems-carry)
+            nrd = numElems-carry;
+        size_t at = cursor%f->ringElems;
+        size_t first = nrd<f->ringElems-at? nrd: f->ringElems-at;
+        memcpy(wrbuf+carry*elemSize, ring+at*elemSize, first*elemSize);
+        memcpy(wrbuf+(carry+first)*elemSize, ring, (nrd-first)*elemSize);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (f->reserve.load(std::memory_order_relaxed)-cursor>f->ringElems) {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "fanoutPump: %d: overrun shared stream, data loss", conn->netSock);
+            cursor = f->head.load()-f->ringElems/2;
+            carry = 0;
+            continue;
+        }
+        const TCPRemoteLevel &lvl = conn->wireLevels[conn->wireLevel];
+        size_t have = carry+nrd;
+        uint64_t base = cursor-carry;
+        cursor += nrd;
+        carry = 0;
+        const void *out = wrbuf;
+        size_t olen = have*elemSize;
+        if (lvl.format!=f->fmtCode || lvl.decim>1) {
+            // convert and/or decimate, keeping any partial decimation for next time
+            size_t nout = convertSamples(cvbuf, lvl.format, wrbuf, f->fmtCode, have, numChans, lvl.decim);
+            carry = have - nout*lvl.decim;
+            memmove(wrbuf, wrbuf+(have-carry)*elemSize, carry*elemSize);
+            out = cvbuf;
+            olen = nout*formatSize(lvl.format)*numChans;
+        }
+        if (0==olen)
+            continue;
+        // time the block from the latest mark before it
+        uint32_t flags = 0;
+        long long timeNs = 0;
+        {
+            std::lock_guard<std::mutex> lock(f->mutex);
+            auto it = f->marks.rbegin();
+            while (it!=f->marks.rend() && it->at>base)
+                ++it;
+            if (it!=f->marks.rend()) {
+                flags = SOAPY_SDR_HAS_TIME | (it->host? TCPREMOTE_BLOCK_HOSTTIME: 0);
+                timeNs = it->timeNs;
+                if (f->sampleRate>0)
+                    timeNs += (long long)(((double)base-(double)it->at)*1e9/f->sampleRate);
+            }
+        }
+        if (writeBlock(conn, lvl, out, olen, false, flags, timeNs)<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "fanoutPump: unable to write to network: %s", strerror(errno));
+            break;
+        }
+        firstSent(conn);
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        // check for congestion every 50msecs, our backlog is how far behind we are
+        if (tsdiff(&lchk, &ts)>=50000) {
+            lchk = ts;
+            adaptWireLevel(conn, (int)((f->head.load()-cursor)*100/f->ringElems), &ts, &lchg, &lbusy);
+        }
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "fanoutPump: stop: %d", conn->netSock);
+}
+
+// empty the pipe (& marks) left by the last activation, while netPump is parked
+void pipereset(ConnectionInfo *conn) {
+    pthread_mutex_lock(&conn->netPipe->mutex);
+    conn->netPipe->in = conn->netPipe->out = 0;
+    conn->marks.clear();
+    pthread_mutex_unlock(&conn->netPipe->mutex);
+}
+
+// wake netPump for another run, & wait for it to park again (after the final pipe write)
+void netStart(ConnectionInfo *conn) {
+    StreamPumps *pumps = conn->pumps;
+    std::lock_guard<std::mutex> lock(pumps->mutex);
+    ++pumps->netWant;
+    pumps->cond.notify_all();
+}
+
+void netWait(ConnectionInfo *conn) {
+    StreamPumps *pumps = conn->pumps;
+    std::unique_lock<std::mutex> lock(pumps->mutex);
+    pumps->cond.wait(lock, [pumps]{ return pumps->netRan==pumps->netWant; });
+}
+
+// take the device for a driver call from a pump, as its clients' RPCs do, false if stopped first.
+// NB: whoever stops us may hold the device (in an RPC), so don't wait on it blindly
+bool pumpLock(std::unique_lock<std::mutex> &devLock, volatile bool &running) {
+    while (running) {
+        if (devLock.try_lock())
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+// the stream's sample rate (0 if unknown, or stopped before we could ask)
+double pumpSampleRate(ConnectionInfo *conn) {
+    std::unique_lock<std::mutex> devLock(conn->shared->rpcMutex, std::defer_lock);
+    if (!pumpLock(devLock, conn->running))
+        return 0;
+    double rate = conn->dev->getSampleRate(conn->direction, conn->channels.at(0));
+    return rate>0? rate: 0;
+}
+
+// tell other clients the frequency of hopping channels changed, at most every 100 msecs
+// (due is set while one is held back), & once more as the schedule stops
+void hopChanged(ConnectionInfo *conn, struct timespec &last, bool &due, bool force) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!force && tsdiff(&last, &now)<100000) {
+        due = true;
+        return;
+    }
+    for (auto chn: conn->channels)
+        notifyChange(*conn, changeKey(SOAPY_SDR_RX, chn, "frequency"));
+    last = now;
+    due = false;
+}
+
+// one activation's worth of device reading, until deactivated or a burst ends
+void dataPump(ConnectionInfo *conn) {
     SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: start: %d", conn->netSock);
-    // first - activate the underlying stream
-    if (conn->dev->activateStream(conn->stream)) {
+    // first - activate the underlying stream, at a time and/or for a burst if asked
+    if (conn->dev->activateStream(conn->stream, conn->actFlags, conn->actTime, conn->actElems)) {
         SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: failed to activate underlying stream");
-        return nullptr;
+        return;
     }
+    struct timespec act;
+    clock_gettime(CLOCK_MONOTONIC, &act);
+    conn->pumps->activeUs = tsdiff(&conn->pumps->asked, &act);
+    pipereset(conn);
     // special case: one channel, in native format, with direct buffers supported - we can avoid lots of work
     double full;
-    if (1==conn->channels.size()
+    if (1==conn->channels.size() && conn->hops.empty() && 0==conn->actElems
         && conn->dev->getNativeStreamFormat(conn->direction, conn->channels.at(0), full)==conn->format
         && conn->dev->getNumDirectAccessBuffers(conn->stream) > 0) {
         SoapySDR_log(SOAPY_SDR_DEBUG, "dataPump: using direct buffers");
         if (SOAPY_SDR_RX!=conn->direction) {
             SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: transmit not supported - sorry :=(");
             conn->dev->deactivateStream(conn->stream);
-            return nullptr;
+            return;
         }
-        // make the network output pipe (10x MTU for jitter buffering)
         size_t fSize = g_frameSizes.at(conn->format);
-        size_t mtu = conn->dev->getStreamMTU(conn->stream);
-        size_t pipeSize = mtu * fSize * 10;
-        conn->netPipe = newpipe(pipeSize);
-        // start network pump, unless asked to use direct write
+        conn->sampleRate = pumpSampleRate(conn);
+        uint64_t written = 0;
+        // start network pump, unless asked to use direct write (which cannot adapt)
         bool bDirect = nullptr!=getenv("SOAPY_TCPREMOTE_DIRECT_WRITE");
-        pthread_t fpid;
-        if (!bDirect) {
-            pthread_create(&fpid, nullptr, netPump, conn);
+        if (bDirect && conn->wireLevels.size()>1) {
+            SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: direct write ignored, tcpremote:adapt needs the network pump");
+            bDirect = false;
         }
-        while (conn->pid!=0) {
+        if (!bDirect)
+            netStart(conn);
+        while (conn->running) {
             // map a buffer, copy to pipe, repeat => simples :)
             size_t handle;
             const void *pBuf;
@@ -338,27 +1727,39 @@ void *dataPump(void *ctx) {
                 SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: error mapping direct buffer: %s", SoapySDR_errToStr(err));
                 break;
             }
+            StreamMark tm = timeMark(conn->sampleRate, written, flags, timeNs, err);
             if (bDirect) {
-                if (send(conn->netSock, pBuf, err*fSize, MSG_DONTWAIT)!=(int)(err*fSize)) {
+                uint32_t bflags = SOAPY_SDR_HAS_TIME | (tm.host? TCPREMOTE_BLOCK_HOSTTIME: 0);
+                int sent = writeBlock(conn, conn->wireLevels[0], pBuf, err*fSize, true, bflags, tm.timeNs);
+                if (sent<0) {
                     SoapySDR_logf(SOAPY_SDR_WARNING, "dataPump: direct write error: %s", strerror(errno));
+                } else if (0==sent) {
+                    SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: overrun network socket, data loss");
+                } else {
+                    firstSent(conn);
                 }
             } else {
-                if (pipewrite((void *)pBuf, fSize, err, conn->netPipe, false)<0) {
+                pushMark(conn, tm);
+                int nput = pipewrite((void *)pBuf, fSize, err, conn->netPipe, false);
+                if (nput<err) {
                     SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: overrun network pipe, data loss");
+                    moveMarks(conn, written+(nput>0? nput: 0));
                 }
+                if (nput>0)
+                    written += nput;
             }
             conn->dev->releaseReadBuffer(conn->stream, handle);
         }
         if (!bDirect) {
-            // final write to ensure netPump wakes up and terminates
-            pipewrite((void *)".", 1, 1, conn->netPipe, false);
-            pthread_join(fpid, nullptr);
+            // final write (of a whole element) to ensure netPump wakes up and terminates
+            uint8_t nul[8] = {0};
+            pipewrite(nul, fSize, 1, conn->netPipe, false);
+            netWait(conn);
         }
-        free(conn->netPipe);
         // stop the byte flood :=)
         conn->dev->deactivateStream(conn->stream);
         SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: stop: %d", conn->netSock);
-        return nullptr;
+        return;
     }
     // which direction?
     if (SOAPY_SDR_RX==conn->direction) {
@@ -369,27 +1770,79 @@ void *dataPump(void *ctx) {
         size_t elemSize = fSize * numChans;
         size_t chnSize = numElems * fSize;
         size_t readSize = chnSize * numChans;
-        // inter-thread pipe large enough to hold 10xMTU, should cope with TCP jitter
-        size_t pipeSize = readSize * 10;
-        // allocate buffers & pointers to them
+        // our buffers (after the pipe) & pointers to them
         void *buffs[numChans];
-        uint8_t cbuf[readSize];
-        uint8_t pbuf[readSize];
-        conn->netPipe = newpipe(pipeSize);
+        uint8_t *cbuf = (uint8_t *)conn->pumps->dataMem.data()+readSize*10;
+        uint8_t *pbuf = cbuf+readSize;
         for (size_t c=0; c<numChans; ++c)
             buffs[c] = cbuf+(c*chnSize);
         SoapySDR_logf(SOAPY_SDR_TRACE, "dataPump: numElems=%d", numElems);
+        // hop schedule, timed in samples: retune, drop settle time samples, then dwell
+        bool hopping = !conn->hops.empty();
+        double rate = pumpSampleRate(conn);
+        conn->sampleRate = rate;
+        if (hopping && rate<=0 && conn->running) {
+            SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: unknown sample rate, hop schedule ignored");
+            hopping = false;
+        }
+        StreamMark mark = { 0, StreamMark::DWELL, { 0, 0, 0 } };
+        size_t next = 0;
+        uint32_t pass = 0;
+        bool fresh = false;
+        uint64_t settle = 0, dwell = 0, written = 0, burst = conn->actElems;
+        // frequency change events for other clients (see hopChanged())
+        struct timespec hopEvent = { 0, 0 };
+        bool hopDue = false;
         // start network pump
-        pthread_t fpid;
-        pthread_create(&fpid, nullptr, netPump, conn);
+        netStart(conn);
         // pump until told to stop!
         struct timespec lt;
         clock_gettime(CLOCK_MONOTONIC, &lt);
-        while (conn->pid!=0) {
+        while (conn->running) {
+            if (hopping && 0==settle && 0==dwell) {
+                if (next>=conn->hops.size()) {
+                    next = 0;
+                    if (conn->hopPasses>0 && (int)++pass>=conn->hopPasses) {
+                        // all done, carry on at the last frequency
+                        StreamMark done = { written, StreamMark::DWELL, { TCPREMOTE_DWELL_DONE, pass, mark.dwell.frequency } };
+                        pushMark(conn, done);
+                        hopping = false;
+                        continue;
+                    }
+                }
+                double freq = conn->hops[next].first;
+                std::unique_lock<std::mutex> devLock(conn->shared->rpcMutex, std::defer_lock);
+                if (!pumpLock(devLock, conn->running))
+                    break;
+                try {
+                    for (auto chn: conn->channels)
+                        conn->dev->setFrequency(SOAPY_SDR_RX, chn, freq);
+                } catch (const std::exception &ex) {
+                    SoapySDR_logf(SOAPY_SDR_ERROR, "dataPump: retune to %f: %s", freq, ex.what());
+                }
+                devLock.unlock();
+                hopChanged(conn, hopEvent, hopDue, false);
+                settle = (uint64_t)(conn->hopSettle*rate+0.5);
+                dwell = (uint64_t)(conn->hops[next].second*rate+0.5);
+                if (0==dwell)
+                    dwell = 1;
+                mark = { 0, StreamMark::DWELL, { (uint32_t)next, pass, freq } };
+                fresh = true;
+                ++next;
+            }
+            // never read across a settle or dwell boundary
+            size_t want = numElems;
+            if (hopping && want>(settle? settle: dwell))
+                want = settle? settle: dwell;
+            if (conn->actElems>0 && want>burst)
+                want = burst;
             int flags = 0;
             long long time = 0;
             long timeout = 1000000; // 1 second
-            int nread = conn->dev->readStream(conn->stream, buffs, numElems, flags, time, timeout);
+            int nread = conn->dev->readStream(conn->stream, buffs, want, flags, time, timeout);
+            // nothing yet (eg: waiting for a timed start)
+            if (SOAPY_SDR_TIMEOUT==nread)
+                continue;
             if (nread<0) {
                 SoapySDR_logf(SOAPY_SDR_ERROR,
                     "dataPump: error reading underlying stream: %s", SoapySDR_errToStr(nread));
@@ -398,6 +1851,30 @@ void *dataPump(void *ctx) {
                     continue;
                 break;
             }
+            if (hopDue)
+                hopChanged(conn, hopEvent, hopDue, false);
+            if (hopping && settle>0) {
+                settle -= nread;
+                continue;
+            }
+            // time the samples, netPump stamps each block from this
+            if (nread>0)
+                pushMark(conn, timeMark(conn->sampleRate, written, flags, time, nread));
+            if (hopping && nread>0) {
+                // start mark with the first samples of a dwell, end mark with the last
+                if (fresh) {
+                    mark.at = written;
+                    pushMark(conn, mark);
+                    fresh = false;
+                }
+                dwell -= nread;
+                if (0==dwell) {
+                    StreamMark last = mark;
+                    last.at = written+nread;
+                    last.kind = StreamMark::END;
+                    pushMark(conn, last);
+                }
+            }
             // interleave samples across channels for network format:
             // Soapy readStream (channelized) format:
             //            <--------- nread -------//--->
@@ -441,15 +1918,34 @@ void *dataPump(void *ctx) {
             SoapySDR_logf(SOAPY_SDR_TRACE, "%ld: dataPump: p<=%d",
                 tsdiff(&lt, &ts), elemSize*nread);
             lt = ts;
+            // end of a burst, we stop once it has been sent
+            bool ended = false;
+            if (conn->actElems>0) {
+                burst -= nread;
+                ended = 0==burst || (flags & SOAPY_SDR_END_BURST);
+                if (ended) {
+                    StreamMark last = { written+nread, StreamMark::LAST, { 0, 0, 0 } };
+                    pushMark(conn, last);
+                }
+            }
             // push to pipe in multiples of element size
-            if (nullptr==getenv("INHIBIT_PIPE") && pipewrite(pbuf, elemSize, nread, conn->netPipe, false)<0) {
+            int nput = nullptr==getenv("INHIBIT_PIPE")? pipewrite(pbuf, elemSize, nread, conn->netPipe, false): nread;
+            if (nput<nread) {
                 SoapySDR_log(SOAPY_SDR_WARNING, "dataPump: overrun network pipe, data loss");
+                // dwells & bursts end where their samples did
+                moveMarks(conn, written+(nput>0? nput: 0));
             }
+            if (nput>0)
+                written += nput;
+            if (ended)
+                break;
         }
-        // final write to ensure netPump wakes up and terminates
+        // final write to ensure netPump wakes up and parks
         pipewrite(pbuf, elemSize, 1, conn->netPipe, false);
-        pthread_join(fpid, nullptr);
-        free(conn->netPipe);
+        netWait(conn);
+        // hopping channels now stay where they are
+        if (!conn->hops.empty())
+            hopChanged(conn, hopEvent, hopDue, true);
     } else {
         // TODO:XXX:
         SoapySDR_log(SOAPY_SDR_ERROR, "dataPump: unimplemented data receive funtion :=(");
@@ -457,43 +1953,357 @@ void *dataPump(void *ctx) {
     // dropping out - deactivate underlying stream
     conn->dev->deactivateStream(conn->stream);
     SoapySDR_logf(SOAPY_SDR_DEBUG, "dataPump: stop: %d", conn->netSock);
+}
+
+// one activation's worth of reading a shared stream into its ring, until its last connection deactivates
+void fanoutRead(StreamFanout *f) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "fanoutRead: start");
+    if (f->dev->activateStream(f->stream)) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "fanoutRead: failed to activate underlying stream");
+        return;
+    }
+    std::unique_lock<std::mutex> devLock(*f->rpcMutex, std::defer_lock);
+    if (pumpLock(devLock, f->running)) {
+        double rate = f->dev->getSampleRate(SOAPY_SDR_RX, f->channels.at(0));
+        f->sampleRate = rate>0? rate: 0;
+        devLock.unlock();
+    }
+    size_t numChans = f->channels.size();
+    uint8_t *ring = (uint8_t *)f->mem.data();
+    uint8_t *cbuf = ring+f->ringElems*f->elemSize;
+    void *buffs[numChans];
+    for (size_t c=0; c<numChans; ++c)
+        buffs[c] = cbuf+c*f->readElems*f->fSize;
+    while (f->running) {
+        int flags = 0;
+        long long time = 0;
+        int nread = f->dev->readStream(f->stream, buffs, f->readElems, flags, time, 1000000);
+        if (SOAPY_SDR_TIMEOUT==nread || 0==nread)
+            continue;
+        if (nread<0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "fanoutRead: error reading underlying stream: %s", SoapySDR_errToStr(nread));
+            if (nread==SOAPY_SDR_OVERFLOW)
+                continue;
+            break;
+        }
+        // claim the space (before touching it), interleave into it (as dataPump), then publish
+        uint64_t head = f->head.load(std::memory_order_relaxed);
+        f->reserve.store(head+nread, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        size_t at = head%f->ringElems;
+        for (int idx=0; idx<nread; ++idx) {
+            uint8_t *pn = ring+at*f->elemSize;
+            for (size_t c=0; c<numChans; ++c) {
+                memcpy(pn, (uint8_t *)buffs[c]+idx*f->fSize, f->fSize);
+                pn += f->fSize;
+            }
+            if (++at==f->ringElems)
+                at = 0;
+        }
+        {
+            std::lock_guard<std::mutex> lock(f->mutex);
+            f->marks.push_back(timeMark(f->sampleRate, head, flags, time, nread));
+            // keep the mark timing the oldest samples in the ring
+            while (f->marks.size()>1 && f->marks[1].at+f->ringElems<=head+nread)
+                f->marks.pop_front();
+            f->head.store(head+nread);
+        }
+        f->cond.notify_all();
+    }
+    f->dev->deactivateStream(f->stream);
+    SoapySDR_log(SOAPY_SDR_DEBUG, "fanoutRead: stop");
+}
+
+// pump threads park until asked for another run (or to quit)
+void *dataPumpThread(void *ctx) {
+    ConnectionInfo *conn = (ConnectionInfo *)ctx;
+    StreamPumps *pumps = conn->pumps;
+    std::unique_lock<std::mutex> lock(pumps->mutex);
+    while (true) {
+        pumps->cond.wait(lock, [pumps]{ return pumps->quit || pumps->dataRan!=pumps->dataWant; });
+        if (pumps->quit)
+            break;
+        uint32_t run = pumps->dataWant;
+        lock.unlock();
+        dataPump(conn);
+        lock.lock();
+        pumps->dataRan = run;
+        pumps->cond.notify_all();
+    }
     return nullptr;
 }
 
-int handleListen(struct pollfd *pfd) {
-    // oops before expected..
-    if (pfd->revents & (POLLERR|POLLHUP)) {
-        SoapySDR_log(SOAPY_SDR_ERROR,"EOF or error in listen socket");
-        return -1;
+void *netPumpThread(void *ctx) {
+    ConnectionInfo *conn = (ConnectionInfo *)ctx;
+    StreamPumps *pumps = conn->pumps;
+    std::unique_lock<std::mutex> lock(pumps->mutex);
+    while (true) {
+        pumps->cond.wait(lock, [pumps]{ return pumps->quit || pumps->netRan!=pumps->netWant; });
+        if (pumps->quit)
+            break;
+        uint32_t run = pumps->netWant;
+        lock.unlock();
+        if (conn->fanout)
+            fanoutPump(conn);
+        else
+            netPump(conn);
+        lock.lock();
+        pumps->netRan = run;
+        pumps->cond.notify_all();
     }
-    // connect pending
-    if (pfd->revents & POLLIN) {
-        struct sockaddr addr;
-        socklen_t len = sizeof(addr);
-        int sock = accept(pfd->fd, &addr, &len);
-        if (sock<0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR,"error accepting connection: %s", strerror(errno));
-            return -1;
-        }
-        // now we read an integer which types the connection
-        char buf[2];
-        if (read(sock, buf, 2)<=0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR,"error reading connection type: %s", strerror(errno));
-            close(sock);
-            return -1;
-        }
-        int type = buf[0]-'0';
-        // create appropriate ConnectionInfo and insert into map..
-        if (TCPREMOTE_RPC_LOAD==type)
-            return createRpc(sock);
-        else if (TCPREMOTE_LOG_STREAM==type)
-            return createLog(sock);
-        else if (TCPREMOTE_DATA_SEND==type || TCPREMOTE_DATA_RECV==type)
-            return createData(sock, type);
-        // ..or drop it as unknown.
-        SoapySDR_logf(SOAPY_SDR_ERROR, "unknown connection type: %d", type);
+    return nullptr;
+}
+
+void *fanoutThread(void *ctx) {
+    StreamFanout *f = (StreamFanout *)ctx;
+    std::unique_lock<std::mutex> lock(f->mutex);
+    while (true) {
+        f->cond.wait(lock, [f]{ return f->quit || f->ran!=f->want; });
+        if (f->quit)
+            break;
+        uint32_t run = f->want;
+        lock.unlock();
+        fanoutRead(f);
+        lock.lock();
+        f->ran = run;
+        f->cond.notify_all();
+    }
+    return nullptr;
+}
+
+// channels opened in sessions arrive here, from the session threads
+static int s_sessionPipe[2];
+
+void sessionAccept(int sock) {
+    if (write(s_sessionPipe[1], &sock, sizeof(sock))!=sizeof(sock))
+        SoapySDR_logf(SOAPY_SDR_ERROR, "sessionAccept: %s", strerror(errno));
+}
+
+int createSession(int sock) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "createSession()");
+    // read the window size line, byte at a time as frames follow immediately
+    char buf[16];
+    size_t len = 0;
+    while (len<sizeof(buf)-1 && read(sock, buf+len, 1)==1 && buf[len]!='\n')
+        ++len;
+    buf[len] = 0;
+    size_t window = strtoul(buf, nullptr, 10);
+    if (window<TCPREMOTE_MUX_CHUNK)
+        window = TCPREMOTE_MUX_WINDOW;
+    // frames carry RPC replies, don't wait to coalesce them
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    // the session runs in its own thread until the client goes away
+    SoapyMux *mux = new SoapyMux(sock, window, sessionAccept);
+    std::thread([mux]{ mux->run(); delete mux; }).detach();
+    SoapySDR_logf(SOAPY_SDR_INFO, "New session: %d, window %d", sock, (int)window);
+    return 0;
+}
+
+int handleConnection(int sock) {
+    // now we read an integer which types the connection
+    char buf[2];
+    if (read(sock, buf, 2)<=0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"error reading connection type: %s", strerror(errno));
         close(sock);
+        return -1;
+    }
+    int type = buf[0]-'0';
+    // create appropriate ConnectionInfo and insert into map..
+    if (TCPREMOTE_RPC_LOAD==type) {
+        RpcWorker *worker = newWorker();
+        workerPost(worker, [sock, worker]{ createRpc(sock, worker); });
+        return 0;
+    }
+    else if (TCPREMOTE_LOG_STREAM==type)
+        return createLog(sock);
+    else if (TCPREMOTE_DATA_SEND==type || TCPREMOTE_DATA_RECV==type || TCPREMOTE_DATA_SEND_BLOCKS==type)
+        return createData(sock, type);
+    else if (TCPREMOTE_LINK_PROBE==type)
+        return createProbe(sock);
+    else if (TCPREMOTE_SESSION==type)
+        return createSession(sock);
+    else if (TCPREMOTE_CLOCK_SYNC==type)
+        return createClock(sock);
+    // ..or drop it as unknown.
+    SoapySDR_logf(SOAPY_SDR_ERROR, "unknown connection type: %d", type);
+    close(sock);
+    return 0;
+}
+
+// accept any connections waiting on the listen socket or session pipe, without blocking
+void pendingConnections(int lsock, std::vector<int> &socks) {
+    struct pollfd pfds[2] = { { lsock, POLLIN, 0 }, { s_sessionPipe[0], POLLIN, 0 } };
+    while (poll(pfds, 2, 0)>0 && ((pfds[0].revents|pfds[1].revents) & POLLIN)) {
+        if (pfds[0].revents & POLLIN) {
+            struct sockaddr_storage addr;
+            socklen_t len = sizeof(addr);
+            int sock = accept(lsock, (struct sockaddr *)&addr, &len);
+            if (sock<0) {
+                SoapySDR_logf(SOAPY_SDR_ERROR,"error accepting connection: %s", strerror(errno));
+                return;
+            }
+            socks.push_back(sock);
+        }
+        if (pfds[1].revents & POLLIN) {
+            int sock;
+            if (read(s_sessionPipe[0], &sock, sizeof(sock))==sizeof(sock))
+                socks.push_back(sock);
+        }
+    }
+}
+
+// new connections, until their first byte (the type) arrives
+static std::set<int> s_untyped;
+
+// set up new connections that have sent their type, log streams before anything else: clients
+// connect their log stream and RPC in parallel, sending the log request first, so the log
+// stream sees messages from driver loads.
+void typeConnections() {
+    std::vector<int> logs, others;
+    for (int sock: s_untyped) {
+        char type;
+        ssize_t n = recv(sock, &type, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n<0 && (EAGAIN==errno || EWOULDBLOCK==errno || EINTR==errno))
+            continue;
+        // NB: EOF or errors are dropped by handleConnection
+        if (1==n && TCPREMOTE_LOG_STREAM==type-'0')
+            logs.push_back(sock);
+        else
+            others.push_back(sock);
+    }
+    for (auto list: { &logs, &others }) {
+        for (int sock: *list) {
+            s_untyped.erase(sock);
+            s_reactor.remove(sock);
+            handleConnection(sock);
+        }
+    }
+}
+
+// accept everything waiting, then type whatever we can
+int handleListen(int lsock) {
+    std::vector<int> socks;
+    pendingConnections(lsock, socks);
+    for (int sock: socks) {
+        s_untyped.insert(sock);
+        s_reactor.add(sock, [lsock](uint32_t) { handleListen(lsock); });
+    }
+    typeConnections();
+    return 0;
+}
+
+// the map key of a connection
+int connectionId(ConnectionInfo &conn) {
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    for (auto &it: s_connections) {
+        if (&it.second==&conn)
+            return it.first;
+    }
+    return -1;
+}
+
+// the host a connection comes from (numeric, IPv4 mapped as IPv4), "" if not over IP (eg: sessions)
+std::string peerHost(int fd) {
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    char host[NI_MAXHOST];
+    if (getpeername(fd, (struct sockaddr *)&addr, &len)<0
+        || getnameinfo((struct sockaddr *)&addr, len, host, sizeof(host), nullptr, 0, NI_NUMERICHOST))
+        return "";
+    std::string rv = host;
+    return rv.compare(0, 7, "::ffff:")==0? rv.substr(7): rv;
+}
+
+// may an RPC connection have things sent to a log stream? Only its own client's, which
+// comes from the same host, and the first to claim it keeps it
+bool claimLog(ConnectionInfo &conn, int logId) {
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    auto it = s_connections.find(logId);
+    if (it==s_connections.end() || !it->second.log)
+        return false;
+    int id = connectionId(conn);
+    ConnectionInfo &log = it->second;
+    if ((log.logOwner>=0 && log.logOwner!=id) || peerHost(id)!=peerHost(logId)) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "claimLog: log stream %d does not belong to connection %d", logId, id);
+        return false;
+    }
+    log.logOwner = id;
+    return true;
+}
+
+// tell clients of a device (but not the one making it, if any) that a setting changed, via their log streams
+void notifyDevice(SoapySDR::Device *dev, ConnectionInfo *conn, const std::string &key) {
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    for (auto &it: s_connections) {
+        ConnectionInfo &ci = it.second;
+        if (!ci.log || ci.events<0)
+            continue;
+        auto src = s_connections.find(ci.events);
+        if (src==s_connections.end() || &src->second==conn || src->second.dev!=dev)
+            continue;
+        logSend(ci, "E:"+key+"\n");
+    }
+}
+
+// tell other clients of the same device that a setting changed, via their log streams
+void notifyChange(ConnectionInfo &conn, const std::string &key) {
+    notifyDevice(conn.dev, &conn, key);
+}
+
+// a setter ran: tell the others now, & if it was timed (see handleSetCommandTime()) tell
+// everyone (ourselves too) again as it takes effect, as until then they read the old value.
+// Called holding the device, so we may ask it the time.
+void notifySetter(ConnectionInfo &conn, const std::string &key) {
+    notifyChange(conn, key);
+    if (0==conn.cmdTime)
+        return;
+    long long now = 0;
+    try {
+        now = conn.dev->getHardwareTime(conn.cmdWhat);
+    } catch (const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "notifySetter: getHardwareTime: %s", ex.what());
+    }
+    // just after it, within an hour (should the device not keep time)
+    long long wait = conn.cmdTime>now? (conn.cmdTime-now)/1000000+1: 0;
+    long msecs = wait>3600000? 3600000: (long)wait;
+    SoapySDR::Device *dev = conn.dev;
+    s_reactor.post([msecs, dev, key]{
+        s_reactor.timer(msecs, [dev, key]{ notifyDevice(dev, nullptr, key); });
+    });
+}
+
+// run a device setter, 0 or -1 if it threw (logged), or -2 if this client may not change settings
+template <typename F>
+int runSetter(ConnectionInfo &conn, const char *what, F setter) {
+    const char *why;
+    if (!mayControl(conn, why)) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "%s: refused, %s", what, why);
+        return -2;
     }
+    try {
+        setter();
+    } catch (const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "%s: %s", what, ex.what());
+        return -1;
+    }
+    return 0;
+}
+
+// run a device setter, replying with its status: 0 or -1 if it threw or was refused,
+// the client may collect this reply later if it is pipelining setters. Other
+// clients are notified of the change (key) unless refused.
+template <typename F>
+int setterReply(ConnectionInfo &conn, const char *what, F setter) {
+    return conn.rpc->writeInteger(runSetter(conn, what, setter)<0? -1: 0);
+}
+
+template <typename F>
+int setterStatus(ConnectionInfo &conn, const char *what, const std::string &key, F setter) {
+    int status = runSetter(conn, what, setter);
+    conn.rpc->writeInteger(status<0? -1: 0);
+    if (status>-2)
+        notifySetter(conn, key);
     return 0;
 }
 
@@ -519,9 +2329,7 @@ int handleSetFrontendMapping(ConnectionInfo &conn) {
     // protocol incorrectly. I have been bitten once, PAA.
     int dir = conn.rpc->readInteger();
     std::string cfg = conn.rpc->readString();
-    conn.dev->setFrontendMapping(dir, cfg);
-    conn.rpc->writeInteger(0);
-    return 0;
+    return setterStatus(conn, "setFrontendMapping", "", [&]{ conn.dev->setFrontendMapping(dir, cfg); });
 }
 
 int handleGetFrontendMapping(ConnectionInfo &conn) {
@@ -564,11 +2372,7 @@ int handleGetStreamFormats(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetStreamFormats()");
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
-    for (auto &fmt: conn.dev->getStreamFormats(dir,chn)) {
-        conn.rpc->writeString(fmt);
-    }
-    // terminate list
-    conn.rpc->writeString("");
+    conn.rpc->writeStrVector(conn.dev->getStreamFormats(dir,chn));
     return 0;
 }
 
@@ -593,6 +2397,127 @@ int handleGetStreamArgsInfo(ConnectionInfo &conn) {
     return 0;
 }
 
+// parse a space separated hop list: "<freq>[/<dwell>] ..." or ranges "<start>:<stop>:<step>[/<dwell>]",
+// each without a dwell time (secs) using the given default
+bool parseHops(const std::string &spec, double dwell, std::vector<std::pair<double, double>> &hops) {
+    size_t cur, nxt = -1;
+    do {
+        cur = nxt+1;
+        nxt = spec.find(' ', cur);
+        std::string hop = spec.substr(cur, nxt-cur);
+        if (hop.length()==0)
+            continue;
+        double dw = dwell;
+        size_t sl = hop.find('/');
+        if (sl!=std::string::npos) {
+            dw = atof(hop.substr(sl+1).c_str());
+            hop = hop.substr(0, sl);
+        }
+        double start, stop, step;
+        char end;
+        if (3==sscanf(hop.c_str(), "%lf:%lf:%lf%c", &start, &stop, &step, &end)) {
+            if (step<=0 || stop<start || (stop-start)/step>100000)
+                return false;
+            for (long n=0; start+n*step<=stop+step/1e6; ++n)
+                hops.push_back(std::make_pair(start+n*step, dw));
+        } else if (1==sscanf(hop.c_str(), "%lf%c", &start, &end)) {
+            hops.push_back(std::make_pair(start, dw));
+        } else {
+            return false;
+        }
+        if (dw<=0)
+            return false;
+    } while (nxt!=std::string::npos);
+    return true;
+}
+
+// a data connection not yet set up as (or striped with) a stream?
+bool unclaimedData(int id) {
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    auto it = s_connections.find(id);
+    return it!=s_connections.end() && !it->second.rpc && !it->second.log && !it->second.stream;
+}
+
+// share our device's receive stream of these channels, or set one up reading in our format
+StreamFanout *attachFanout(ConnectionInfo &conn, ConnectionInfo &data, const SoapySDR::Kwargs &devArgs) {
+    std::string key;
+    for (auto chn: data.channels)
+        key += std::to_string(chn)+" ";
+    auto it = conn.shared->fanouts.find(key);
+    if (it!=conn.shared->fanouts.end()) {
+        StreamFanout *f = it->second;
+        ++f->refs;
+        SoapySDR_logf(SOAPY_SDR_INFO, "setupStream: %d: sharing stream of channels %s(%d connections)", data.netSock, key.c_str(), f->refs);
+        return f;
+    }
+    SoapySDR::Stream *stream = conn.dev->setupStream(SOAPY_SDR_RX, data.format, data.channels, devArgs);
+    if (!stream)
+        return nullptr;
+    StreamFanout *f = new StreamFanout();
+    f->dev = conn.dev;
+    f->rpcMutex = &conn.shared->rpcMutex;
+    f->stream = stream;
+    f->format = data.format;
+    f->fmtCode = formatCode(data.format);
+    f->fSize = g_frameSizes.at(data.format);
+    f->channels = data.channels;
+    f->readElems = conn.dev->getStreamMTU(stream);
+    f->elemSize = f->fSize*data.channels.size();
+    // room for 16 reads (our own pipes hold 10), as senders may be held up by the network
+    f->ringElems = f->readElems*16;
+    f->head = f->reserve = 0;
+    f->sampleRate = 0;
+    f->refs = 1;
+    f->active = 0;
+    f->want = f->ran = 0;
+    f->running = false;
+    f->quit = false;
+    // the reader goes where this connection's data pump would, with the ring & its buffers
+    std::vector<int> cpus = data.sched.dataCpus;
+    if (data.sched.isolated && !s_isolatedCpus.empty())
+        cpus.assign(1, s_isolatedCpus[s_nextIsolated.fetch_add(1)%s_isolatedCpus.size()]);
+    SoapySDRLogLevel level = data.sched.bufConfigured? SOAPY_SDR_WARNING: SOAPY_SDR_DEBUG;
+    std::string what = "setupStream: "+std::to_string(data.netSock)+": shared stream buffers";
+    f->mem.setup(data.sched.buffers, cpus.empty()? -1: cpuNode(cpus[0]), what, level);
+    int err = -1;
+    if (f->mem.ensure((f->ringElems+f->readElems)*f->elemSize)) {
+        err = startPump(&f->reader, fanoutThread, f, data.sched, data.netSock, cpus, "shared reader");
+        if (err)
+            SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: failed to create shared reader thread: %s", strerror(err));
+    }
+    if (err) {
+        conn.dev->closeStream(stream);
+        delete f;
+        return nullptr;
+    }
+    conn.shared->fanouts[key] = f;
+    SoapySDR_logf(SOAPY_SDR_INFO, "setupStream: %d: shared stream of channels %s(%s, %s)", data.netSock, key.c_str(),
+        f->format.c_str(), f->mem.info().c_str());
+    return f;
+}
+
+// the last connection of a shared stream closes it
+void releaseFanout(ConnectionInfo &conn, ConnectionInfo &data) {
+    StreamFanout *f = data.fanout;
+    data.fanout = nullptr;
+    if (--f->refs>0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(f->mutex);
+        f->quit = true;
+    }
+    f->cond.notify_all();
+    pthread_join(f->reader, nullptr);
+    f->dev->closeStream(f->stream);
+    for (auto it = conn.shared->fanouts.begin(); it!=conn.shared->fanouts.end(); ++it) {
+        if (it->second==f) {
+            conn.shared->fanouts.erase(it);
+            break;
+        }
+    }
+    delete f;
+}
+
 int handleSetupStream(ConnectionInfo &conn) {
     // The actually complex(ish) bit..
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetupStream()");
@@ -602,7 +2527,7 @@ int handleSetupStream(ConnectionInfo &conn) {
     std::string chans = conn.rpc->readString();
     SoapySDR::Kwargs args = conn.rpc->readKwargs();
     // find the data stream (client must connect a data stream first)
-    if (s_connections.find(dataId)==s_connections.end()) {
+    if (!unclaimedData(dataId)) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
@@ -622,45 +2547,309 @@ int handleSetupStream(ConnectionInfo &conn) {
         nxt = chans.find(' ',cur);
         channels.push_back(atoi(chans.substr(cur, nxt-cur).c_str()));
     } while (nxt!=std::string::npos);
+    // extract our own options (tcpremote:<x>), the rest are for the underlying driver
+    SoapySDR::Kwargs devArgs;
+    for (auto &kv: args) {
+        if (kv.first.compare(0, 10, "tcpremote:")!=0)
+            devArgs[kv.first] = kv.second;
+    }
+    // wire format ladder, starting with the stream format
+    std::vector<TCPRemoteLevel> levels;
+    TCPRemoteLevel base = { formatCode(fmt), 1 };
+    levels.push_back(base);
+    if (args.find("tcpremote:adapt")!=args.end()) {
+        bool ok = parseLevels(args.at("tcpremote:adapt"), levels);
+        for (auto &l: levels) {
+            if (formatSize(l.format)>formatSize(base.format))
+                ok = false;
+        }
+        if (!ok) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: invalid tcpremote:adapt levels: %s", args.at("tcpremote:adapt").c_str());
+            conn.rpc->writeInteger(-5);
+            return 0;
+        }
+    }
+    // hop schedule (receive only)
+    std::vector<std::pair<double, double>> hops;
+    if (args.find("tcpremote:hops")!=args.end()) {
+        double dwell = args.find("tcpremote:dwell")!=args.end()? atof(args.at("tcpremote:dwell").c_str()): 0.1;
+        if (SOAPY_SDR_RX!=direction || !parseHops(args.at("tcpremote:hops"), dwell, hops) || hops.empty()) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: invalid tcpremote:hops schedule: %s", args.at("tcpremote:hops").c_str());
+            conn.rpc->writeInteger(-6);
+            return 0;
+        }
+    }
+    // striped: the client connected more data streams, listed by ID, to carry blocks too
+    std::vector<int> stripes;
+    if (args.find("tcpremote:stripe_ids")!=args.end()) {
+        const std::string &ids = args.at("tcpremote:stripe_ids");
+        nxt = -1;
+        do {
+            cur = nxt+1;
+            nxt = ids.find(' ', cur);
+            if (nxt==cur)
+                continue;
+            int id = atoi(ids.substr(cur, nxt-cur).c_str());
+            if (id==dataId || !unclaimedData(id) || !findConnection(id)->framed) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: invalid stripe data stream ID: %d", id);
+                conn.rpc->writeInteger(-7);
+                return 0;
+            }
+            stripes.push_back(id);
+        } while (nxt!=std::string::npos);
+    }
+    // adapting, hopping & striping all need a receive stream sent in blocks
+    if (SOAPY_SDR_RX==direction && !findConnection(dataId)->framed && (levels.size()>1 || !hops.empty() || !stripes.empty())) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: tcpremote:adapt, tcpremote:hops & tcpremote:stripe_ids need a framed data stream");
+        conn.rpc->writeInteger(-14);
+        return 0;
+    }
+    // pump placement, server defaults unless asked otherwise
+    PumpSched sched = s_pumpSched;
+    if ((args.find("tcpremote:cpus")!=args.end() && !parseAffinity(args.at("tcpremote:cpus"), sched))
+        || (args.find("tcpremote:sched")!=args.end() && !parseSched(args.at("tcpremote:sched"), sched))
+        || (args.find("tcpremote:buffers")!=args.end() && !parseBufferFlags(args.at("tcpremote:buffers"), sched.buffers))) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: invalid tcpremote:cpus, tcpremote:sched or tcpremote:buffers");
+        conn.rpc->writeInteger(-8);
+        return 0;
+    }
+    if (args.find("tcpremote:buffers")!=args.end())
+        sched.bufConfigured = true;
+    // transmitting & hopping change the device for everyone
+    const char *why;
+    if ((SOAPY_SDR_TX==direction || !hops.empty()) && !mayControl(conn, why)) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "setupStream: %s refused, %s", SOAPY_SDR_TX==direction? "transmit": "hop schedule", why);
+        conn.rpc->writeInteger(-10);
+        return 0;
+    }
+    // share a receive stream with other connections to the device? (by default when relaying)
+    bool fanout = args.find("tcpremote:fanout")!=args.end()? "true"==args.at("tcpremote:fanout"):
+        s_relayAddress.length()>0 && SOAPY_SDR_RX==direction && hops.empty();
+    if (fanout && (SOAPY_SDR_RX!=direction || !hops.empty())) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: tcpremote:fanout is for receive streams without hop schedules");
+        conn.rpc->writeInteger(-11);
+        return 0;
+    }
+    // uplink caps & weight (receive only), Mbit/s on the wire
+    double maxRate = args.find("tcpremote:max_rate")!=args.end()? atof(args.at("tcpremote:max_rate").c_str())*1e6/8: 0;
+    double weight = args.find("tcpremote:weight")!=args.end()? atof(args.at("tcpremote:weight").c_str()): 1;
+    if (maxRate<0 || weight<=0) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: invalid tcpremote:max_rate or tcpremote:weight");
+        conn.rpc->writeInteger(-12);
+        return 0;
+    }
     // fill out the connection details
-    ConnectionInfo &data = s_connections.at(dataId);
+    ConnectionInfo &data = *findConnection(dataId);
     data.dev = conn.dev;
+    data.shared = conn.shared;
     data.direction = direction;
     data.format = fmt;
     data.channels = channels;
-    // open the underlying stream
-    data.stream = conn.dev->setupStream(direction, fmt, channels, args);
+    data.wireLevels = levels;
+    data.wireLevel = 0;
+    if (args.find("tcpremote:adapt_high")!=args.end())
+        data.adaptHigh = atoi(args.at("tcpremote:adapt_high").c_str());
+    if (args.find("tcpremote:adapt_low")!=args.end())
+        data.adaptLow = atoi(args.at("tcpremote:adapt_low").c_str());
+    if (args.find("tcpremote:adapt_hold")!=args.end())
+        data.adaptHold = atoi(args.at("tcpremote:adapt_hold").c_str());
+    data.hops = hops;
+    data.hopSettle = args.find("tcpremote:settle")!=args.end()? atof(args.at("tcpremote:settle").c_str()): 0;
+    data.hopPasses = args.find("tcpremote:hop_passes")!=args.end()? atoi(args.at("tcpremote:hop_passes").c_str()): 0;
+    data.sched = sched;
+    // commit its share of the uplink, if within budget
+    if (SOAPY_SDR_RX==direction && !commitShare(conn, data, maxRate, weight, false, "setupStream")) {
+        conn.rpc->writeInteger(-13);
+        return 0;
+    }
+    // open the underlying stream, or share one
+    if (fanout) {
+        data.fanout = attachFanout(conn, data, devArgs);
+        data.stream = data.fanout? data.fanout->stream: nullptr;
+    } else {
+        data.stream = conn.dev->setupStream(direction, fmt, channels, devArgs);
+    }
     if (!data.stream) {
         SoapySDR_log(SOAPY_SDR_ERROR, "setupStream: failed to create underlying stream");
+        idleShare(data, true);
         conn.rpc->writeInteger(-4);
+        return 0;
+    }
+    // start the stream's (parked) pumps
+    if (internalStartPumps(data)) {
+        if (data.fanout)
+            releaseFanout(conn, data);
+        else
+            conn.dev->closeStream(data.stream);
+        data.stream = nullptr;
+        idleShare(data, true);
+        conn.rpc->writeInteger(-9);
+        return 0;
+    }
+    // all good! stripes now belong to this stream
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        for (int id: stripes)
+            s_connections.erase(id);
     }
-    // all good!
+    data.stripes = stripes;
     conn.dataIds.insert(dataId);
     conn.rpc->writeInteger(dataId);
     return 0;
 }
 
+// stop any activation, waiting for the pumps to park
+// wake a shared stream's reader as its first connection activates, & stop it after the last
+void fanoutJoin(ConnectionInfo &data) {
+    StreamFanout *f = data.fanout;
+    data.joined = true;
+    if (f->active++>0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(f->mutex);
+        f->running = true;
+        ++f->want;
+    }
+    f->cond.notify_all();
+}
+
+void fanoutLeave(ConnectionInfo &data) {
+    StreamFanout *f = data.fanout;
+    data.joined = false;
+    if (--f->active>0)
+        return;
+    f->running = false;
+    std::unique_lock<std::mutex> lock(f->mutex);
+    f->cond.wait(lock, [f]{ return f->ran==f->want; });
+}
+
 int internalStopPumps(ConnectionInfo &data) {
-    if (data.pid) {
-        pthread_t pid = data.pid;
-        data.pid = 0;
-        if (pthread_join(pid, nullptr)) {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "internalStopPumps: failed to join data pump thread: %s", strerror(errno));
-            return -1;
+    StreamPumps *pumps = data.pumps;
+    data.running = false;
+    idleShare(data, false);
+    if (pumps && data.fanout) {
+        // our sender may be waiting for samples (it also looks every 100 msecs)
+        data.fanout->cond.notify_all();
+        std::unique_lock<std::mutex> lock(pumps->mutex);
+        pumps->cond.wait(lock, [pumps]{ return pumps->netRan==pumps->netWant; });
+        lock.unlock();
+        if (data.joined)
+            fanoutLeave(data);
+    } else if (pumps) {
+        std::unique_lock<std::mutex> lock(pumps->mutex);
+        pumps->cond.wait(lock, [pumps]{ return pumps->dataRan==pumps->dataWant; });
+    }
+    return 0;
+}
+
+// start the (parked) pump threads, with their pipe & buffers, as the stream is set up (a shared
+// stream's connections have only a network pump, sending from the ring)
+int internalStartPumps(ConnectionInfo &data) {
+    StreamPumps *pumps = new StreamPumps();
+    pumps->dataWant = pumps->dataRan = pumps->netWant = pumps->netRan = 0;
+    pumps->quit = false;
+    pumps->activeUs = 0;
+    pumps->sent = false;
+    // on the next isolated CPUs (reader, then sender), or as configured
+    std::vector<int> dataCpus = data.sched.dataCpus, netCpus = data.sched.netCpus;
+    if (data.sched.isolated) {
+        if (s_isolatedCpus.empty()) {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "setupStream: %d: no isolated CPUs (see isolcpus), pumps not pinned", data.netSock);
+        } else {
+            unsigned next = s_nextIsolated.fetch_add(2);
+            dataCpus.assign(1, s_isolatedCpus[next%s_isolatedCpus.size()]);
+            netCpus.assign(1, s_isolatedCpus[(next+1)%s_isolatedCpus.size()]);
         }
     }
+    // buffers, prefaulted now & on the NUMA node of their pump: the inter-thread pipe (large
+    // enough to hold 10xMTU, should cope with TCP jitter) goes with the reader
+    size_t elemSize = g_frameSizes.at(data.format) * data.channels.size();
+    pumps->readSize = data.dev->getStreamMTU(data.stream) * elemSize;
+    pumps->netElems = netPumpElems(elemSize);
+    // ring elements in, ours (or a wire level, widest) out
+    size_t netSize = pumps->netElems*elemSize*2;
+    if (data.fanout) {
+        elemSize = data.fanout->elemSize;
+        pumps->readSize = 0;
+        pumps->netElems = netPumpElems(elemSize);
+        netSize = pumps->netElems*(elemSize+formatSize(TCPREMOTE_FMT_CF32)*data.channels.size());
+    }
+    SoapySDRLogLevel level = data.sched.bufConfigured? SOAPY_SDR_WARNING: SOAPY_SDR_DEBUG;
+    std::string what = "setupStream: "+std::to_string(data.netSock);
+    pumps->dataMem.setup(data.sched.buffers, dataCpus.empty()? -1: cpuNode(dataCpus[0]), what+": data pump buffers", level);
+    pumps->netMem.setup(data.sched.buffers, netCpus.empty()? -1: cpuNode(netCpus[0]), what+": network pump buffers", level);
+    void *dataMem = data.fanout? nullptr: pumps->dataMem.ensure(pumps->readSize*12);
+    if ((!dataMem && !data.fanout) || !pumps->netMem.ensure(netSize)) {
+        delete pumps;
+        return -1;
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "%s: data pump buffers: %s, network pump buffers: %s", what.c_str(),
+        pumps->dataMem.info().c_str(), pumps->netMem.info().c_str());
+    if (!data.fanout)
+        data.netPipe = newpipe(dataMem, pumps->readSize*10);
+    data.pumps = pumps;
+    // create ourselves real-time threads to read the data & send it..
+    int err = data.fanout? 0: startPump(&pumps->data, dataPumpThread, &data, data.sched, data.netSock, dataCpus, "data");
+    if (err) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: failed to create data pump thread: %s", strerror(err));
+    } else if ((err = startPump(&pumps->net, netPumpThread, &data, data.sched, data.netSock, netCpus, "network"))) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setupStream: failed to create network pump thread: %s", strerror(err));
+        {
+            std::lock_guard<std::mutex> lock(pumps->mutex);
+            pumps->quit = true;
+        }
+        pumps->cond.notify_all();
+        if (!data.fanout)
+            pthread_join(pumps->data, nullptr);
+    }
+    if (err) {
+        data.pumps = nullptr;
+        free(data.netPipe);
+        data.netPipe = nullptr;
+        delete pumps;
+        return -1;
+    }
     return 0;
 }
 
+// stop & end the pump threads, when the stream closes
+void internalEndPumps(ConnectionInfo &data) {
+    StreamPumps *pumps = data.pumps;
+    if (!pumps)
+        return;
+    internalStopPumps(data);
+    {
+        std::lock_guard<std::mutex> lock(pumps->mutex);
+        pumps->quit = true;
+    }
+    pumps->cond.notify_all();
+    if (!data.fanout)
+        pthread_join(pumps->data, nullptr);
+    pthread_join(pumps->net, nullptr);
+    data.pumps = nullptr;
+    free(data.netPipe);
+    data.netPipe = nullptr;
+    delete pumps;
+}
+
 int internalCloseStream(ConnectionInfo &conn, int dataId) {
-    if (s_connections.find(dataId)==s_connections.end()) {
+    ConnectionInfo *data = findStream(conn, dataId);
+    if (!data) {
         SoapySDR_logf(SOAPY_SDR_WARNING, "closeStream: no such data stream ID: %d", dataId);
         return 0;
     }
-    ConnectionInfo &data = s_connections.at(dataId);
-    internalStopPumps(data);
-    data.dev->closeStream(data.stream);
-    s_connections.erase(dataId);
+    internalEndPumps(*data);
+    idleShare(*data, true);
+    if (data->fanout)
+        releaseFanout(conn, *data);
+    else
+        data->dev->closeStream(data->stream);
+    for (int id: data->stripes)
+        close(id);
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        s_connections.erase(dataId);
+    }
     close(dataId);
     conn.dataIds.erase(dataId);
     SoapySDR_logf(SOAPY_SDR_INFO, "Closed data connection: %d", dataId);
@@ -679,56 +2868,96 @@ int handleGetStreamMTU(ConnectionInfo &conn) {
     // pass-thru
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetStreamMTU()");
     int dataId = conn.rpc->readInteger();
-    if (s_connections.find(dataId)==s_connections.end()) {
+    ConnectionInfo *data = findStream(conn, dataId);
+    if (!data) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "getStreamMTU: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
     }
-    return conn.rpc->writeInteger(conn.dev->getStreamMTU(s_connections.at(dataId).stream));
+    return conn.rpc->writeInteger(conn.dev->getStreamMTU(data->stream));
+}
+
+int startDataPump(ConnectionInfo &conn, ConnectionInfo &data) {
+    // a shared stream runs as its connections need it, timing & bursts are not theirs to ask for
+    if (data.fanout && (data.actFlags || data.actTime || data.actElems)) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "activateStream: timed or burst activation of a shared stream");
+        conn.rpc->writeInteger(SOAPY_SDR_NOT_SUPPORTED);
+        return 0;
+    }
+    // stop any earlier activation (or collect a finished burst), then wake the data pump for another run
+    // (or join a shared stream's reader & wake our sender)
+    internalStopPumps(data);
+    // commit its share of the uplink again, at the rate it now has
+    if (SOAPY_SDR_RX==data.direction
+        && !commitShare(conn, data, -1, -1, true, "activateStream")) {
+        conn.rpc->writeInteger(SOAPY_SDR_STREAM_ERROR);
+        return 0;
+    }
+    StreamPumps *pumps = data.pumps;
+    if (data.fanout)
+        fanoutJoin(data);
+    {
+        std::lock_guard<std::mutex> lock(pumps->mutex);
+        clock_gettime(CLOCK_MONOTONIC, &pumps->asked);
+        pumps->sent = false;
+        pumps->activeUs = 0;
+        data.running = true;
+        if (data.fanout)
+            ++pumps->netWant;
+        else
+            ++pumps->dataWant;
+    }
+    pumps->cond.notify_all();
+    conn.rpc->writeInteger(0);
+    return 0;
 }
 
 int handleActivateStream(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleActivateStream()");
     int dataId = conn.rpc->readInteger();
-    if (s_connections.find(dataId)==s_connections.end()) {
+    ConnectionInfo *data = findStream(conn, dataId);
+    if (!data) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "activateStream: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
-    }
-    // start data pump thread
-    ConnectionInfo &data = s_connections.at(dataId);
-    data.pid = -1;  // non-zero, to prevent thread terminating if it's scheduled before we can copy in real value!
-    // create ourselves a real-time thread to read the data..
-    pthread_attr_t pat;
-    pthread_attr_init(&pat);
-    pthread_attr_setschedpolicy(&pat, SCHED_FIFO);
-    struct sched_param sch;
-    sch.sched_priority = 1;
-    pthread_attr_setschedparam(&pat, &sch);
-    pthread_t pid;
-    if (pthread_create(&pid, &pat, dataPump, &data)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR, "activateStream: failed to create data pump thread: %s", strerror(errno));
-        data.pid = 0;
-        conn.rpc->writeInteger(-2);
+    }
+    data->actFlags = 0;
+    data->actTime = 0;
+    data->actElems = 0;
+    return startDataPump(conn, *data);
+}
+
+int handleActivateStreamAt(ConnectionInfo &conn) {
+    // timed and/or finite burst activation
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleActivateStreamAt()");
+    int dataId = conn.rpc->readInteger();
+    int flags = conn.rpc->readInteger();
+    long long timeNs = conn.rpc->readLong();
+    long long numElems = conn.rpc->readLong();
+    ConnectionInfo *data = findStream(conn, dataId);
+    if (!data) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "activateStream: no such data stream ID: %d", dataId);
+        conn.rpc->writeInteger(-1);
         return 0;
     }
-    pthread_attr_destroy(&pat);
-    data.pid = pid;
-    conn.rpc->writeInteger(0);
-    return 0;
+    data->actFlags = flags;
+    data->actTime = timeNs;
+    data->actElems = numElems>0? numElems: 0;
+    return startDataPump(conn, *data);
 }
 
+
 int handleDeactivateStream(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleDeactivateStream()");
     int dataId = conn.rpc->readInteger();
-    if (s_connections.find(dataId)==s_connections.end()) {
+    ConnectionInfo *data = findStream(conn, dataId);
+    if (!data) {
         SoapySDR_logf(SOAPY_SDR_ERROR, "deactivateStream: no such data stream ID: %d", dataId);
         conn.rpc->writeInteger(-1);
         return 0;
     }
     // stop data pump thread
-    ConnectionInfo &data = s_connections.at(dataId);
-    if (internalStopPumps(data))
+    if (internalStopPumps(*data))
         conn.rpc->writeInteger(-2);
     else
         conn.rpc->writeInteger(0);
@@ -750,9 +2979,7 @@ int handleSetAntenna(ConnectionInfo &conn) {
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
     std::string nam = conn.rpc->readString();
-    conn.dev->setAntenna(dir,chn,nam);
-    conn.rpc->writeInteger(0);
-    return 0;
+    return setterStatus(conn, "setAntenna", changeKey(dir,chn,"antenna"), [&]{ conn.dev->setAntenna(dir,chn,nam); });
 }
 
 int handleGetAntenna(ConnectionInfo &conn) {
@@ -788,8 +3015,13 @@ int handleSetGainMode(ConnectionInfo &conn) {
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
     int set = conn.rpc->readInteger();
-    conn.dev->setGainMode(dir,chn,set>0);
-    conn.rpc->writeInteger(0);
+    // the mode, & gains it now moves (or leaves)
+    int status = runSetter(conn, "setGainMode", [&]{ conn.dev->setGainMode(dir,chn,set>0); });
+    conn.rpc->writeInteger(status<0? -1: 0);
+    if (status>-2) {
+        notifySetter(conn, changeKey(dir,chn,"gain_mode"));
+        notifySetter(conn, changeKey(dir,chn,"gain"));
+    }
     return 0;
 }
 
@@ -808,9 +3040,7 @@ int handleSetGain(ConnectionInfo &conn) {
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
     double gain = conn.rpc->readDouble();
-    conn.dev->setGain(dir,chn,gain);
-    conn.rpc->writeInteger(0);
-    return 0;
+    return setterStatus(conn, "setGain", changeKey(dir,chn,"gain"), [&]{ conn.dev->setGain(dir,chn,gain); });
 }
 
 int handleSetGainNamed(ConnectionInfo &conn) {
@@ -820,9 +3050,7 @@ int handleSetGainNamed(ConnectionInfo &conn) {
     int chn = conn.rpc->readInteger();
     std::string nam = conn.rpc->readString();
     double gain = conn.rpc->readDouble();
-    conn.dev->setGain(dir,chn,nam,gain);
-    conn.rpc->writeInteger(0);
-    return 0;
+    return setterStatus(conn, "setGain", changeKey(dir,chn,"gain"), [&]{ conn.dev->setGain(dir,chn,nam,gain); });
 }
 
 int handleGetGain(ConnectionInfo &conn) {
@@ -849,10 +3077,7 @@ int handleGetGainRange(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetGainRange()");
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
-    SoapySDR::Range r = conn.dev->getGainRange(dir,chn);
-    conn.rpc->writeDouble(r.minimum());
-    conn.rpc->writeDouble(r.maximum());
-    conn.rpc->writeDouble(r.step());
+    conn.rpc->writeRange(conn.dev->getGainRange(dir,chn));
     return 0;
 }
 
@@ -862,10 +3087,7 @@ int handleGetGainRangeNamed(ConnectionInfo &conn) {
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
     std::string nam = conn.rpc->readString();
-    SoapySDR::Range r = conn.dev->getGainRange(dir,chn,nam);
-    conn.rpc->writeDouble(r.minimum());
-    conn.rpc->writeDouble(r.maximum());
-    conn.rpc->writeDouble(r.step());
+    conn.rpc->writeRange(conn.dev->getGainRange(dir,chn,nam));
     return 0;
 }
 
@@ -876,9 +3098,7 @@ int handleSetFrequency(ConnectionInfo &conn) {
     int chn = conn.rpc->readInteger();
     double frq = conn.rpc->readDouble();
     SoapySDR::Kwargs kwargs = conn.rpc->readKwargs();
-    conn.dev->setFrequency(dir,chn,frq,kwargs);
-    conn.rpc->writeInteger(0);
-    return 0;
+    return setterStatus(conn, "setFrequency", changeKey(dir,chn,"frequency"), [&]{ conn.dev->setFrequency(dir,chn,frq,kwargs); });
 }
 
 int handleSetFrequencyNamed(ConnectionInfo &conn) {
@@ -889,9 +3109,7 @@ int handleSetFrequencyNamed(ConnectionInfo &conn) {
     std::string nam = conn.rpc->readString();
     double frq = conn.rpc->readDouble();
     SoapySDR::Kwargs kwargs = conn.rpc->readKwargs();
-    conn.dev->setFrequency(dir,chn,nam,frq,kwargs);
-    conn.rpc->writeInteger(0);
-    return 0;
+    return setterStatus(conn, "setFrequency", changeKey(dir,chn,"frequency"), [&]{ conn.dev->setFrequency(dir,chn,nam,frq,kwargs); });
 }
 
 int handleGetFrequency(ConnectionInfo &conn) {
@@ -927,15 +3145,7 @@ int handleGetFrequencyRange(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetFrequencyRange()");
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
-    SoapySDR::RangeList list = conn.dev->getFrequencyRange(dir,chn);
-    for (auto r: list) {
-        conn.rpc->writeDouble(r.minimum());
-        conn.rpc->writeDouble(r.maximum());
-        conn.rpc->writeDouble(r.step());
-    }
-    conn.rpc->writeDouble(0);
-    conn.rpc->writeDouble(0);
-    conn.rpc->writeDouble(-1.0);
+    conn.rpc->writeRangeList(conn.dev->getFrequencyRange(dir,chn));
     return 0;
 }
 int handleGetFrequencyRangeNamed(ConnectionInfo &conn) {
@@ -944,15 +3154,7 @@ int handleGetFrequencyRangeNamed(ConnectionInfo &conn) {
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
     std::string nam = conn.rpc->readString();
-    SoapySDR::RangeList list = conn.dev->getFrequencyRange(dir,chn,nam);
-    for (auto r: list) {
-        conn.rpc->writeDouble(r.minimum());
-        conn.rpc->writeDouble(r.maximum());
-        conn.rpc->writeDouble(r.step());
-    }
-    conn.rpc->writeDouble(0);
-    conn.rpc->writeDouble(0);
-    conn.rpc->writeDouble(-1.0);
+    conn.rpc->writeRangeList(conn.dev->getFrequencyRange(dir,chn,nam));
     return 0;
 }
 int handleGetFrequencyArgsInfo(ConnectionInfo &conn) {
@@ -970,9 +3172,7 @@ int handleSetSampleRate(ConnectionInfo &conn) {
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
     double rate = conn.rpc->readDouble();
-    conn.dev->setSampleRate(dir,chn,rate);
-    conn.rpc->writeInteger(0);
-    return 0;
+    return setterStatus(conn, "setSampleRate", changeKey(dir,chn,"sample_rate"), [&]{ conn.dev->setSampleRate(dir,chn,rate); });
 }
 
 int handleGetSampleRate(ConnectionInfo &conn) {
@@ -989,15 +3189,34 @@ int handleGetSampleRateRange(ConnectionInfo &conn) {
     SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetSampleRateRange()");
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
-    SoapySDR::RangeList list = conn.dev->getSampleRateRange(dir,chn);
-    for (auto r: list) {
-        conn.rpc->writeDouble(r.minimum());
-        conn.rpc->writeDouble(r.maximum());
-        conn.rpc->writeDouble(r.step());
-    }
-    conn.rpc->writeDouble(0);
-    conn.rpc->writeDouble(0);
-    conn.rpc->writeDouble(-1.0);
+    conn.rpc->writeRangeList(conn.dev->getSampleRateRange(dir,chn));
+    return 0;
+}
+
+int handleSetBandwidth(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetBandwidth()");
+    int dir = conn.rpc->readInteger();
+    int chn = conn.rpc->readInteger();
+    double bw = conn.rpc->readDouble();
+    return setterStatus(conn, "setBandwidth", changeKey(dir,chn,"bandwidth"), [&]{ conn.dev->setBandwidth(dir,chn,bw); });
+}
+
+int handleGetBandwidth(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetBandwidth()");
+    int dir = conn.rpc->readInteger();
+    int chn = conn.rpc->readInteger();
+    conn.rpc->writeDouble(conn.dev->getBandwidth(dir,chn));
+    return 0;
+}
+
+int handleGetBandwidthRange(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetBandwidthRange()");
+    int dir = conn.rpc->readInteger();
+    int chn = conn.rpc->readInteger();
+    conn.rpc->writeRangeList(conn.dev->getBandwidthRange(dir,chn));
     return 0;
 }
 
@@ -1016,9 +3235,7 @@ int handleSetFrequencyCorrection(ConnectionInfo &conn) {
     int dir = conn.rpc->readInteger();
     int chn = conn.rpc->readInteger();
     double val = conn.rpc->readDouble();
-    conn.dev->setFrequencyCorrection(dir,chn,val);
-    conn.rpc->writeInteger(0);
-    return 0;    
+    return setterStatus(conn, "setFrequencyCorrection", changeKey(dir,chn,"frequency_correction"), [&]{ conn.dev->setFrequencyCorrection(dir,chn,val); });
 }
 
 int handleGetFrequencyCorrection(ConnectionInfo &conn) {
@@ -1030,45 +3247,549 @@ int handleGetFrequencyCorrection(ConnectionInfo &conn) {
     return 0;    
 }
 
+int handleSetMasterClockRate(ConnectionInfo &conn) {
+    // pass-thru, may change any rate, so clients discard all cached settings
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetMasterClockRate()");
+    double rate = conn.rpc->readDouble();
+    return setterStatus(conn, "setMasterClockRate", "", [&]{ conn.dev->setMasterClockRate(rate); });
+}
+
+int handleGetMasterClockRate(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetMasterClockRate()");
+    conn.rpc->writeDouble(conn.dev->getMasterClockRate());
+    return 0;
+}
+
+int handleGetMasterClockRates(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetMasterClockRates()");
+    conn.rpc->writeRangeList(conn.dev->getMasterClockRates());
+    return 0;
+}
+
+int handleListClockSources(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleListClockSources()");
+    conn.rpc->writeStrVector(conn.dev->listClockSources());
+    return 0;
+}
+
+int handleSetClockSource(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetClockSource()");
+    std::string src = conn.rpc->readString();
+    return setterReply(conn, "setClockSource", [&]{ conn.dev->setClockSource(src); });
+}
+
+int handleGetClockSource(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetClockSource()");
+    conn.rpc->writeString(conn.dev->getClockSource());
+    return 0;
+}
+
+int handleListTimeSources(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleListTimeSources()");
+    conn.rpc->writeStrVector(conn.dev->listTimeSources());
+    return 0;
+}
+
+int handleSetTimeSource(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetTimeSource()");
+    std::string src = conn.rpc->readString();
+    return setterReply(conn, "setTimeSource", [&]{ conn.dev->setTimeSource(src); });
+}
+
+int handleGetTimeSource(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetTimeSource()");
+    conn.rpc->writeString(conn.dev->getTimeSource());
+    return 0;
+}
+
+int handleHasHardwareTime(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleHasHardwareTime()");
+    std::string what = conn.rpc->readString();
+    conn.rpc->writeInteger(conn.dev->hasHardwareTime(what)? 1: 0);
+    return 0;
+}
+
+int handleGetHardwareTime(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetHardwareTime()");
+    std::string what = conn.rpc->readString();
+    conn.rpc->writeLong(conn.dev->getHardwareTime(what));
+    return 0;
+}
+
+int handleSetHardwareTime(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetHardwareTime()");
+    long long timeNs = conn.rpc->readLong();
+    std::string what = conn.rpc->readString();
+    return setterReply(conn, "setHardwareTime", [&]{ conn.dev->setHardwareTime(timeNs, what); });
+}
+
+int handleSetCommandTime(ConnectionInfo &conn) {
+    // pass-thru, applies to the setters that follow (usually pipelined behind it)
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetCommandTime()");
+    long long timeNs = conn.rpc->readLong();
+    std::string what = conn.rpc->readString();
+    int status = runSetter(conn, "setCommandTime", [&]{ conn.dev->setCommandTime(timeNs, what); });
+    if (0==status) {
+        conn.cmdTime = timeNs;
+        conn.cmdWhat = what;
+    }
+    return conn.rpc->writeInteger(status<0? -1: 0);
+}
+
+void sensorThread(SensorWatch *watch) {
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "sensorThread: start: %d", watch->logId);
+    std::unique_lock<std::mutex> lock(watch->mutex);
+    while (!watch->stop) {
+        for (auto &s: watch->sensors) {
+            // NB: whoever stops us may hold the device (in an RPC), so don't wait on it blindly
+            std::unique_lock<std::mutex> devLock(*watch->rpcMutex, std::defer_lock);
+            while (!watch->stop && !devLock.try_lock())
+                watch->cond.wait_for(lock, std::chrono::milliseconds(1));
+            if (watch->stop)
+                break;
+            std::string val;
+            try {
+                val = s.dir<0? watch->dev->readSensor(s.key): watch->dev->readSensor(s.dir, s.chn, s.key);
+            } catch (const std::exception &ex) {
+                continue;
+            }
+            devLock.unlock();
+            std::string line = "S:"+std::to_string(s.dir)+" "+std::to_string(s.chn)+" "+s.key+"="+val+"\n";
+            std::lock_guard<std::recursive_mutex> connLock(s_connMutex);
+            auto it = s_connections.find(watch->logId);
+            if (it!=s_connections.end() && it->second.log)
+                logSend(it->second, line);
+        }
+        watch->cond.wait_for(lock, std::chrono::milliseconds(watch->interval));
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "sensorThread: stop: %d", watch->logId);
+}
+
+void stopWatch(SensorWatch *watch) {
+    if (!watch)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(watch->mutex);
+        watch->stop = true;
+    }
+    watch->cond.notify_one();
+    watch->thread.join();
+    delete watch;
+}
+
+void stopSensors(ConnectionInfo &conn) {
+    // NB: the log stream's close may take it from us
+    SensorWatch *watch;
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        watch = conn.sensors;
+        conn.sensors = nullptr;
+    }
+    stopWatch(watch);
+}
+
 int dropRPC(ConnectionInfo &conn, int fd) {
     SoapySDR_logf(SOAPY_SDR_INFO,"Dropping connection: %d", fd);
-    delete conn.rpc;
-    while (!conn.dataIds.empty()) {
-        int dataId = *(conn.dataIds.begin());
-        internalCloseStream(conn, dataId);
+    conn.worker->dropped = true;
+    stopSensors(conn);
+    {
+        std::lock_guard<std::mutex> lock(conn.shared->rpcMutex);
+        while (!conn.dataIds.empty()) {
+            int dataId = *(conn.dataIds.begin());
+            internalCloseStream(conn, dataId);
+        }
     }
-    SoapySDR::Device::unmake(conn.dev);
-    s_connections.erase(fd);
+    detachDevice(conn);
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        for (auto &it: s_connections) {
+            if (it.second.events==fd)
+                it.second.events = -1;
+        }
+    }
+    // the rest on the main loop: stop watching the socket before it closes, then finish our worker
+    ConnectionInfo *ci = &conn;
+    s_reactor.post([fd, ci] {
+        s_reactor.remove(fd);
+        endWorker(ci->worker);
+        delete ci->rpc;
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        s_connections.erase(fd);
+    });
     return 0;
 }
 
-int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
-    // oops before expected..
-    if (pfd->revents & (POLLERR|POLLHUP)) {
-        SoapySDR_log(SOAPY_SDR_ERROR,"ERR or HUP on RPC socket");
-        return dropRPC(conn, pfd->fd);
+int handleGetLevel(ConnectionInfo &conn) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleGetLevel()");
+    conn.rpc->writeInteger(TCPREMOTE_PROTOCOL_LEVEL);
+    return 0;
+}
+
+int handleSetCodec(ConnectionInfo &conn) {
+    // reply in the current codec, then switch
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetCodec()");
+    std::string codec = conn.rpc->readString();
+    if (codec!="text" && codec!="binary") {
+        conn.rpc->writeInteger(-1);
+        return 0;
+    }
+    conn.rpc->writeInteger(0);
+    conn.rpc->flush();
+    conn.rpc->setBinary("binary"==codec);
+    return 0;
+}
+
+int handleSetAccess(ConnectionInfo &conn) {
+    // access to our shared device: control (refused if another client has it), observe or shared
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSetAccess()");
+    std::string access = conn.rpc->readString();
+    int want;
+    if ("control"==access)
+        want = ACCESS_CONTROL;
+    else if ("observe"==access)
+        want = ACCESS_OBSERVE;
+    else if ("shared"==access)
+        want = ACCESS_SHARED;
+    else {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "setAccess: unknown access: %s", access.c_str());
+        conn.rpc->writeInteger(-1);
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(s_deviceMutex);
+    SharedDevice *sd = conn.shared;
+    if (ACCESS_CONTROL==want) {
+        if (sd->controller && sd->controller!=&conn) {
+            SoapySDR_logf(SOAPY_SDR_WARNING, "setAccess: another client has control of: %s", conn.devKey.c_str());
+            conn.rpc->writeInteger(-1);
+            return 0;
+        }
+        sd->controller = &conn;
+    } else if (sd->controller==&conn) {
+        sd->controller = nullptr;
+    }
+    conn.access = want;
+    SoapySDR_logf(SOAPY_SDR_INFO, "Client access: %s (%d clients): %s", access.c_str(), sd->refs, conn.devKey.c_str());
+    conn.rpc->writeInteger(0);
+    return 0;
+}
+
+int handleSubscribeEvents(ConnectionInfo &conn) {
+    // forward change events for our device to the given log stream
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSubscribeEvents()");
+    int logId = conn.rpc->readInteger();
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    if (!claimLog(conn, logId)) {
+        conn.rpc->writeInteger(-1);
+        return 0;
+    }
+    s_connections.at(logId).events = connectionId(conn);
+    conn.rpc->writeInteger(0);
+    return 0;
+}
+
+int handleSubscribeSensors(ConnectionInfo &conn) {
+    // sample sensors on our own thread, pushing values to the given log stream (none to stop)
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleSubscribeSensors()");
+    int logId = conn.rpc->readInteger();
+    int interval = conn.rpc->readInteger();
+    int cnt = conn.rpc->readInteger();
+    if (cnt>TCPREMOTE_MAX_ITEMS) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "subscribeSensors: too many sensors: %d", cnt);
+        conn.rpc->writeInteger(-1);
+        return 0;
+    }
+    std::vector<SensorWatch::Sensor> sensors;
+    for (int n=0; n<cnt; ++n) {
+        SensorWatch::Sensor s;
+        s.dir = conn.rpc->readInteger();
+        s.chn = conn.rpc->readInteger();
+        s.key = conn.rpc->readString();
+        sensors.push_back(s);
+    }
+    stopSensors(conn);
+    if (sensors.empty()) {
+        conn.rpc->writeInteger(0);
+        return 0;
+    }
+    // NB: holding the map, so the log stream can't close before we are installed
+    std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+    if (interval<=0 || !claimLog(conn, logId)) {
+        conn.rpc->writeInteger(-1);
+        return 0;
+    }
+    SensorWatch *watch = new SensorWatch();
+    watch->dev = conn.dev;
+    watch->rpcMutex = &conn.shared->rpcMutex;
+    watch->logId = logId;
+    watch->interval = interval;
+    watch->sensors = sensors;
+    watch->stop = false;
+    watch->thread = std::thread(sensorThread, watch);
+    conn.sensors = watch;
+    conn.rpc->writeInteger(0);
+    return 0;
+}
+
+int handleListSensors(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleListSensors()");
+    conn.rpc->writeStrVector(conn.dev->listSensors());
+    return 0;
+}
+
+int handleReadSensor(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleReadSensor()");
+    std::string key = conn.rpc->readString();
+    // drivers may throw on names they don't know, which would end us all
+    std::string val;
+    try {
+        val = conn.dev->readSensor(key);
+    } catch (const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "readSensor(%s): %s", key.c_str(), ex.what());
+    }
+    conn.rpc->writeString(val);
+    return 0;
+}
+
+int handleListChannelSensors(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleListChannelSensors()");
+    int dir = conn.rpc->readInteger();
+    int chn = conn.rpc->readInteger();
+    conn.rpc->writeStrVector(conn.dev->listSensors(dir,chn));
+    return 0;
+}
+
+int handleReadChannelSensor(ConnectionInfo &conn) {
+    // pass-thru
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleReadChannelSensor()");
+    int dir = conn.rpc->readInteger();
+    int chn = conn.rpc->readInteger();
+    std::string key = conn.rpc->readString();
+    std::string val;
+    try {
+        val = conn.dev->readSensor(dir,chn,key);
+    } catch (const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "readSensor(%d,%d,%s): %s", dir, chn, key.c_str(), ex.what());
+    }
+    conn.rpc->writeString(val);
+    return 0;
+}
+
+// one operation of a batch, setting names are those used in change keys, values are strings
+struct BatchOp
+{
+    int dir;
+    int chn;
+    std::string setting;
+    std::string name;       // gain element or frequency component, empty for overall
+    std::string value;
+    std::string prev;       // value before we applied it
+    bool hasPrev;
+};
+
+std::string batchGet(SoapySDR::Device *dev, const BatchOp &op) {
+    double val;
+    if ("frequency"==op.setting)
+        val = op.name.empty()? dev->getFrequency(op.dir,op.chn): dev->getFrequency(op.dir,op.chn,op.name);
+    else if ("gain"==op.setting)
+        val = op.name.empty()? dev->getGain(op.dir,op.chn): dev->getGain(op.dir,op.chn,op.name);
+    else if ("gain_mode"==op.setting)
+        return dev->getGainMode(op.dir,op.chn)? "true": "false";
+    else if ("sample_rate"==op.setting)
+        val = dev->getSampleRate(op.dir,op.chn);
+    else if ("bandwidth"==op.setting)
+        val = dev->getBandwidth(op.dir,op.chn);
+    else if ("frequency_correction"==op.setting)
+        val = dev->getFrequencyCorrection(op.dir,op.chn);
+    else if ("antenna"==op.setting)
+        return dev->getAntenna(op.dir,op.chn);
+    else
+        throw std::runtime_error("unknown setting: "+op.setting);
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", val);
+    return buf;
+}
+
+void batchSet(SoapySDR::Device *dev, const BatchOp &op, const std::string &value) {
+    double val = strtod(value.c_str(), nullptr);
+    if ("frequency"==op.setting) {
+        if (op.name.empty())
+            dev->setFrequency(op.dir,op.chn,val);
+        else
+            dev->setFrequency(op.dir,op.chn,op.name,val);
+    } else if ("gain"==op.setting) {
+        if (op.name.empty())
+            dev->setGain(op.dir,op.chn,val);
+        else
+            dev->setGain(op.dir,op.chn,op.name,val);
+    } else if ("gain_mode"==op.setting)
+        dev->setGainMode(op.dir,op.chn,"true"==value || "1"==value);
+    else if ("sample_rate"==op.setting)
+        dev->setSampleRate(op.dir,op.chn,val);
+    else if ("bandwidth"==op.setting)
+        dev->setBandwidth(op.dir,op.chn,val);
+    else if ("frequency_correction"==op.setting)
+        dev->setFrequencyCorrection(op.dir,op.chn,val);
+    else if ("antenna"==op.setting)
+        dev->setAntenna(op.dir,op.chn,value);
+    else
+        throw std::runtime_error("unknown setting: "+op.setting);
+}
+
+// apply a list of setter operations in order, back to back. If one fails, those already
+// applied are restored (in reverse order) and the rest skipped. Status per operation is
+// 0 (in effect), -1 (failed) or 1 (not in effect: restored or skipped).
+int handleBatch(ConnectionInfo &conn) {
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleBatch()");
+    int num = conn.rpc->readInteger();
+    if (num>TCPREMOTE_MAX_ITEMS) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "batch: too many operations: %d", num);
+        conn.rpc->writeInteger(-1);
+        return 0;
+    }
+    std::vector<BatchOp> ops(num>0? num: 0);
+    for (auto &op: ops) {
+        op.dir = conn.rpc->readInteger();
+        op.chn = conn.rpc->readInteger();
+        op.setting = conn.rpc->readString();
+        op.name = conn.rpc->readString();
+        op.value = conn.rpc->readString();
+    }
+    std::vector<int> status(ops.size(), 1);
+    size_t done = 0;
+    const char *why;
+    if (!ops.empty() && !mayControl(conn, why)) {
+        // nothing applied
+        SoapySDR_logf(SOAPY_SDR_WARNING, "batch: refused, %s", why);
+        conn.rpc->writeInteger(ops.size());
+        status[0] = -1;
+        for (int st: status)
+            conn.rpc->writeInteger(st);
+        return 0;
+    }
+    for (; done<ops.size(); ++done) {
+        BatchOp &op = ops[done];
+        try {
+            op.hasPrev = false;
+            op.prev = batchGet(conn.dev, op);
+            op.hasPrev = true;
+        } catch (const std::exception &ex) {
+            // can't restore this one, but may still set it
+            SoapySDR_logf(SOAPY_SDR_DEBUG, "batch: reading %s: %s", op.setting.c_str(), ex.what());
+        }
+        try {
+            batchSet(conn.dev, op, op.value);
+            status[done] = 0;
+        } catch (const std::exception &ex) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "batch: setting %s: %s", op.setting.c_str(), ex.what());
+            status[done] = -1;
+            break;
+        }
+    }
+    if (done<ops.size()) {
+        for (size_t idx=done; idx-->0; ) {
+            if (!ops[idx].hasPrev)
+                continue;
+            try {
+                batchSet(conn.dev, ops[idx], ops[idx].prev);
+                status[idx] = 1;
+            } catch (const std::exception &ex) {
+                SoapySDR_logf(SOAPY_SDR_ERROR, "batch: restoring %s: %s", ops[idx].setting.c_str(), ex.what());
+            }
+        }
     }
-    // ensure we have a separator
-    if (conn.rpc->readString() != TCPREMOTE_RPC_SEP) {
-        SoapySDR_log(SOAPY_SDR_ERROR,"Missing separator on RPC socket (out of sync?)");
-        return dropRPC(conn, pfd->fd);
+    conn.rpc->writeInteger(ops.size());
+    for (int st: status)
+        conn.rpc->writeInteger(st);
+    // anything we touched may have changed (gain mode alters gains)
+    for (size_t idx=0; idx<ops.size() && idx<=done; ++idx) {
+        const BatchOp &op = ops[idx];
+        notifySetter(conn, changeKey(op.dir, op.chn, op.setting.c_str()));
+        if ("gain_mode"==op.setting)
+            notifySetter(conn, changeKey(op.dir, op.chn, "gain"));
     }
-    // dispatch requested RPC..
-    int call = conn.rpc->readInteger();
-    if (call<0) {
-        SoapySDR_log(SOAPY_SDR_ERROR, "EOF or error on RPC socket");
-        return dropRPC(conn, pfd->fd);
+    return 0;
+}
+
+int handleDescribe(ConnectionInfo &conn) {
+    // all static capabilities of every channel in one response, read by
+    // SoapyTCPRemote::describe(), if any query throws only -1 is sent.
+    SoapySDR_log(SOAPY_SDR_DEBUG, "handleDescribe()");
+    size_t mark = conn.rpc->mark();
+    try {
+        conn.rpc->writeInteger(TCPREMOTE_DESCRIBE_VERSION);
+        conn.rpc->writeString(conn.dev->getHardwareKey());
+        conn.rpc->writeKwargs(conn.dev->getHardwareInfo());
+        for (int dir: {SOAPY_SDR_TX, SOAPY_SDR_RX}) {
+            int nchn = conn.dev->getNumChannels(dir);
+            conn.rpc->writeInteger(nchn);
+            for (int chn=0; chn<nchn; ++chn) {
+                conn.rpc->writeKwargs(conn.dev->getChannelInfo(dir,chn));
+                conn.rpc->writeInteger(conn.dev->getFullDuplex(dir,chn));
+                conn.rpc->writeStrVector(conn.dev->getStreamFormats(dir,chn));
+                double fullScale = 0.0;
+                conn.rpc->writeString(conn.dev->getNativeStreamFormat(dir,chn,fullScale));
+                conn.rpc->writeDouble(fullScale);
+                std::vector<std::string> gains = conn.dev->listGains(dir,chn);
+                conn.rpc->writeStrVector(gains);
+                conn.rpc->writeInteger(conn.dev->hasGainMode(dir,chn));
+                conn.rpc->writeRange(conn.dev->getGainRange(dir,chn));
+                for (auto &nam: gains)
+                    conn.rpc->writeRange(conn.dev->getGainRange(dir,chn,nam));
+                std::vector<std::string> freqs = conn.dev->listFrequencies(dir,chn);
+                conn.rpc->writeStrVector(freqs);
+                conn.rpc->writeRangeList(conn.dev->getFrequencyRange(dir,chn));
+                for (auto &nam: freqs)
+                    conn.rpc->writeRangeList(conn.dev->getFrequencyRange(dir,chn,nam));
+                conn.rpc->writeRangeList(conn.dev->getSampleRateRange(dir,chn));
+                conn.rpc->writeInteger(conn.dev->hasFrequencyCorrection(dir,chn));
+            }
+        }
+    } catch (const std::exception &ex) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "describe: %s", ex.what());
+        conn.rpc->rewind(mark);
+        conn.rpc->writeInteger(-1);
     }
-    SoapySDR_logf(SOAPY_SDR_DEBUG, "handleRPC: call=%d", call);
+    return 0;
+}
+
+int dispatchRPC(ConnectionInfo &conn, int call) {
     switch (call) {
     // unknown
     default:
         SoapySDR_logf(SOAPY_SDR_ERROR,"Unknown RPC call: %d", call);
         conn.rpc->writeInteger(-1000);
         return 0;
-    // special - dropping connection
-    case TCPREMOTE_DROP_RPC:
-        return dropRPC(conn, pfd->fd);
+    // special - protocol level & codec negotiation
+    case TCPREMOTE_GET_LEVEL:
+        return handleGetLevel(conn);
+    case TCPREMOTE_SET_CODEC:
+        return handleSetCodec(conn);
+    case TCPREMOTE_DESCRIBE:
+        return handleDescribe(conn);
+    case TCPREMOTE_SUBSCRIBE_EVENTS:
+        return handleSubscribeEvents(conn);
+    case TCPREMOTE_BATCH:
+        return handleBatch(conn);
+    case TCPREMOTE_SUBSCRIBE_SENSORS:
+        return handleSubscribeSensors(conn);
+    case TCPREMOTE_ACTIVATE_STREAM_AT:
+        return handleActivateStreamAt(conn);
+    case TCPREMOTE_SET_ACCESS:
+        return handleSetAccess(conn);
     // identification API
     case TCPREMOTE_GET_HARDWARE_KEY:
         return handleGetHardwareKey(conn);
@@ -1154,6 +3875,13 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
         return handleGetSampleRate(conn);
     case TCPREMOTE_GET_SAMPLE_RATE_RANGE:
         return handleGetSampleRateRange(conn);
+    // bandwidth API
+    case TCPREMOTE_SET_BANDWIDTH:
+        return handleSetBandwidth(conn);
+    case TCPREMOTE_GET_BANDWIDTH:
+        return handleGetBandwidth(conn);
+    case TCPREMOTE_GET_BANDWIDTH_RANGE:
+        return handleGetBandwidthRange(conn);
     // frontend corrections API
     case TCPREMOTE_HAS_FREQUENCY_CORRECTION:
         return handleHasFrequencyCorrection(conn);
@@ -1161,6 +3889,43 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
         return handleSetFrequencyCorrection(conn);
     case TCPREMOTE_GET_FREQUENCY_CORRECTION:
         return handleGetFrequencyCorrection(conn);
+    // clocking API
+    case TCPREMOTE_SET_MASTER_CLOCK_RATE:
+        return handleSetMasterClockRate(conn);
+    case TCPREMOTE_GET_MASTER_CLOCK_RATE:
+        return handleGetMasterClockRate(conn);
+    case TCPREMOTE_GET_MASTER_CLOCK_RATES:
+        return handleGetMasterClockRates(conn);
+    case TCPREMOTE_LIST_CLOCK_SOURCES:
+        return handleListClockSources(conn);
+    case TCPREMOTE_SET_CLOCK_SOURCE:
+        return handleSetClockSource(conn);
+    case TCPREMOTE_GET_CLOCK_SOURCE:
+        return handleGetClockSource(conn);
+    // time API
+    case TCPREMOTE_LIST_TIME_SOURCES:
+        return handleListTimeSources(conn);
+    case TCPREMOTE_SET_TIME_SOURCE:
+        return handleSetTimeSource(conn);
+    case TCPREMOTE_GET_TIME_SOURCE:
+        return handleGetTimeSource(conn);
+    case TCPREMOTE_HAS_HARDWARE_TIME:
+        return handleHasHardwareTime(conn);
+    case TCPREMOTE_GET_HARDWARE_TIME:
+        return handleGetHardwareTime(conn);
+    case TCPREMOTE_SET_HARDWARE_TIME:
+        return handleSetHardwareTime(conn);
+    case TCPREMOTE_SET_COMMAND_TIME:
+        return handleSetCommandTime(conn);
+    // sensor API
+    case TCPREMOTE_LIST_SENSORS:
+        return handleListSensors(conn);
+    case TCPREMOTE_READ_SENSOR:
+        return handleReadSensor(conn);
+    case TCPREMOTE_LIST_CHANNEL_SENSORS:
+        return handleListChannelSensors(conn);
+    case TCPREMOTE_READ_CHANNEL_SENSOR:
+        return handleReadChannelSensor(conn);
     /* NOT IMPLEMENTED ON CLIENT YET!
     TCPREMOTE_HAS_DC_OFFSET_MODE,
     TCPREMOTE_SET_DC_OFFSET_MODE,
@@ -1171,33 +3936,9 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
     TCPREMOTE_HAS_IQ_BALANCE,
     TCPREMOTE_SET_IQ_BALANCE,
     TCPREMOTE_GET_IQ_BALANCE,
-    // bandwidth API
-    TCPREMOTE_SET_BANDWIDTH,
-    TCPREMOTE_GET_BANDWIDTH,
-    // list bandwidths deprecated, we emulate in client side
-    TCPREMOTE_GET_BANDWIDTH_RANGE,
-    // clocking API
-    TCPREMOTE_SET_MASTER_CLOCK_RATE,
-    TCPREMOTE_GET_MASTER_CLOCK_RATE,
-    TCPREMOTE_GET_MASTER_CLOCK_RATES,
-    TCPREMOTE_LIST_CLOCK_SOURCES,
-    TCPREMOTE_SET_CLOCK_SOURCE,
-    TCPREMOTE_GET_CLOCK_SOURCE,
-    // time API
-    TCPREMOTE_LIST_TIME_SOURCES,
-    TCPREMOTE_SET_TIME_SOURCE,
-    TCPREMOTE_GET_TIME_SOURCE,
-    TCPREMOTE_HAS_HARDWARE_TIME,
-    TCPREMOTE_GET_HARDWARE_TIME,
-    TCPREMOTE_SET_HARDWARE_TIME,
-    TCPREMOTE_SET_COMMAND_TIME,
     // sensor API
-    TCPREMOTE_LIST_SENSORS,
     TCPREMOTE_GET_SENSOR_INFO,
-    TCPREMOTE_READ_SENSOR,
-    TCPREMOTE_LIST_CHANNEL_SENSORS,
     TCPREMOTE_GET_CHANNEL_SENSOR_INFO,
-    TCPREMOTE_READ_CHANNEL_SENSOR,
     // register API
     TCPREMOTE_LIST_REGISTER_INTERFACES,
     TCPREMOTE_WRITE_REGISTER_NAMED,
@@ -1233,18 +3974,76 @@ int handleRPC(struct pollfd *pfd, ConnectionInfo &conn) {
     return 0;
 }
 
+int handleRPC(int fd, uint32_t events, ConnectionInfo &conn) {
+    // oops before expected.. (NB: session channels may hang up with requests still to read)
+    if ((events & (EPOLLERR|EPOLLHUP)) && !(events & EPOLLIN)) {
+        SoapySDR_log(SOAPY_SDR_ERROR,"ERR or HUP on RPC socket");
+        return dropRPC(conn, fd);
+    }
+    // handle every request received (clients may pipeline, and we are edge triggered
+    // so drain the socket), then send all the responses together
+    int rv = 0;
+    while (rv>=0 && conn.rpc->hasInput()) {
+        // ensure we have a separator
+        if (conn.rpc->readString() != TCPREMOTE_RPC_SEP) {
+            SoapySDR_log(SOAPY_SDR_ERROR,"Missing separator on RPC socket (out of sync?)");
+            return dropRPC(conn, fd);
+        }
+        // dispatch requested RPC..
+        int call = conn.rpc->readInteger();
+        if (call<0) {
+            SoapySDR_log(SOAPY_SDR_ERROR, "EOF or error on RPC socket");
+            return dropRPC(conn, fd);
+        }
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "handleRPC: call=%d", call);
+        // special - dropping connection
+        if (TCPREMOTE_DROP_RPC==call)
+            return dropRPC(conn, fd);
+        // take turns with other clients of the device
+        std::lock_guard<std::mutex> lock(conn.shared->rpcMutex);
+        rv = dispatchRPC(conn, call);
+    }
+    conn.rpc->flush();
+    return rv;
+}
+
+void closeLog(int fd) {
+    // take it out of the map, then stop anything writing to it
+    FILE *log;
+    std::vector<SensorWatch *> watches;
+    s_reactor.remove(fd);
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        log = s_connections.at(fd).log;
+        s_connections.erase(fd);
+        for (auto &it: s_connections) {
+            if (it.second.sensors && it.second.sensors->logId==fd) {
+                watches.push_back(it.second.sensors);
+                it.second.sensors = nullptr;
+            }
+        }
+    }
+    for (auto watch: watches)
+        stopWatch(watch);
+    fclose(log);
+    SoapySDR_logf(SOAPY_SDR_INFO, "log stream closed: %d", fd);
+}
+
 static bool s_logged;
 static void handleLog(const SoapySDRLogLevel level, const char *message) {
     // pass to all connected log streams if level is appropriate
     s_logged = true;
-    for (auto it = s_connections.begin(); it!=s_connections.end(); ++it) {
-        ConnectionInfo &ci = (*it).second;
-        if (ci.log && ci.level) {
-            // it's a log stream
-            if (level > ci.level)
-                continue;
-            // send level then original message
-            fprintf(ci.log, "%d:%s\n", level, message);
+    {
+        std::lock_guard<std::recursive_mutex> lock(s_connMutex);
+        for (auto it = s_connections.begin(); it!=s_connections.end(); ++it) {
+            ConnectionInfo &ci = (*it).second;
+            if (ci.log && ci.level) {
+                // it's a log stream
+                if (level > ci.level)
+                    continue;
+                // send level then original message
+                logSend(ci, std::to_string(level)+":"+message+"\n");
+            }
         }
     }
     // now our own log
@@ -1255,19 +4054,80 @@ static void handleLog(const SoapySDRLogLevel level, const char *message) {
 
 int usage() {
     puts("usage: SoapyTCPServer [-?|--help] [-l <listen host/IP:default *>] [-p <listen port: default 20655>]");
+    puts("       [-a <pump CPUs>[/<network pump CPUs>]|isolated] [-r fifo|rr|other[:<priority>]: default fifo:1]");
+    puts("       [-b none|huge,lock,numa: pump buffers, default numa]");
+    puts("       [-k <secs to keep idle devices open: default 30>] [--preload <device args> ..]");
+    puts("       [-u <upstream server address to relay> [--relay-args <client options>]]");
+    puts("       [--budget <uplink Mbit/s shared by streams>] [--client-cap <Mbit/s>] [--pacing socket|bucket]");
     return 0;
 }
 
 int main(int argc, char **argv) {
-    const char *host = "0.0.0.0";
+    const char *host = nullptr;           // any, IPv4 and IPv6
     const char *port = "20655";           // 0x50AF ~= SOAP
+    std::vector<std::string> preload;
     for (int arg=1; arg<argc; ++arg) {
         if (strncmp(argv[arg],"-?",2)==0 || strncmp(argv[arg],"--h",3)==0)
             return usage();
+        else if (strcmp(argv[arg],"--preload")==0) {
+            if (++arg>=argc)
+                return usage();
+            preload.push_back(argv[arg]);
+        }
+        else if (strcmp(argv[arg],"--relay-args")==0) {
+            if (++arg>=argc)
+                return usage();
+            s_relayArgs = SoapySDR::KwargsFromString(argv[arg]);
+        }
+        else if (strcmp(argv[arg],"--budget")==0) {
+            if (++arg>=argc || atof(argv[arg])<0)
+                return usage();
+            s_budget = atof(argv[arg])*1e6/8;
+        }
+        else if (strcmp(argv[arg],"--client-cap")==0) {
+            if (++arg>=argc || atof(argv[arg])<0)
+                return usage();
+            s_clientCap = atof(argv[arg])*1e6/8;
+        }
+        else if (strcmp(argv[arg],"--pacing")==0) {
+            if (++arg>=argc || (strcmp(argv[arg],"socket")!=0 && strcmp(argv[arg],"bucket")!=0))
+                return usage();
+            s_pacing = strcmp(argv[arg],"socket")==0? PACING_SOCKET: PACING_BUCKET;
+        }
         else if (strncmp(argv[arg],"-h",2)==0)
             host = argv[++arg];
         else if (strncmp(argv[arg],"-p",2)==0)
             port = argv[++arg];
+        else if (strncmp(argv[arg],"-a",2)==0) {
+            if (++arg>=argc || !parseAffinity(argv[arg], s_pumpSched))
+                return usage();
+        } else if (strncmp(argv[arg],"-r",2)==0) {
+            if (++arg>=argc || !parseSched(argv[arg], s_pumpSched))
+                return usage();
+        } else if (strncmp(argv[arg],"-b",2)==0) {
+            if (++arg>=argc || !parseBufferFlags(argv[arg], s_pumpSched.buffers))
+                return usage();
+            s_pumpSched.bufConfigured = true;
+        } else if (strncmp(argv[arg],"-k",2)==0) {
+            if (++arg>=argc)
+                return usage();
+            s_cacheIdle = atol(argv[arg]);
+        } else if (strncmp(argv[arg],"-u",2)==0) {
+            if (++arg>=argc)
+                return usage();
+            s_relayAddress = argv[arg];
+        }
+    }
+    // the kernel's isolated CPUs, for -a/tcpremote:cpus=isolated
+    FILE *iso = fopen("/sys/devices/system/cpu/isolated", "r");
+    if (iso) {
+        char line[256];
+        if (fgets(line, sizeof(line), iso)) {
+            line[strcspn(line, "\n")] = 0;
+            if (line[0] && !parseCpus(line, s_isolatedCpus))
+                s_isolatedCpus.clear();
+        }
+        fclose(iso);
     }
     // Detect current log level - shenannigans required as we cannot simply read the value
     s_defaultLogLevel = detectLogLevel();
@@ -1275,63 +4135,73 @@ int main(int argc, char **argv) {
     // Now collect all log levels, we filter per-client ourselves
     SoapySDR_registerLogHandler(handleLog);
     SoapySDR_setLogLevel(SOAPY_SDR_TRACE);
-    printf("SoapyTCPServer: listening on: %s:%s\n", host, port);
-    // Set up listen socket
-    struct addrinfo *res = nullptr;
-    if (getaddrinfo(host, port, nullptr, &res)) {
-        SoapySDR_logf(SOAPY_SDR_ERROR,"parsing listen host");
+    printf("SoapyTCPServer: listening on: %s:%s\n", host? host: "*", port);
+    if (s_relayAddress.length()>0)
+        printf("SoapyTCPServer: relaying: %s\n", s_relayAddress.c_str());
+    if (s_budget>0 || s_clientCap>0)
+        printf("SoapyTCPServer: uplink budget: %.1f Mbit/s, per client: %.1f Mbit/s (0 unlimited)\n", s_budget*8/1e6, s_clientCap*8/1e6);
+    // Set up listen socket, IPv6 first as it also accepts IPv4 (where the host allows)
+    struct addrinfo hints, *res = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int rv = getaddrinfo(host, port, &hints, &res);
+    if (rv) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"parsing listen host: %s", gai_strerror(rv));
         return 1;
     }
-    int lsock = socket(AF_INET, SOCK_STREAM, 0);
-    int opt=1;
-    setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(int));
-    if (lsock<0 || bind(lsock, res->ai_addr, res->ai_addrlen)!=0) {
+    int lsock = -1;
+    for (int pass=0; pass<2 && lsock<0; ++pass) {
+        for (struct addrinfo *ai=res; ai && lsock<0; ai=ai->ai_next) {
+            if ((AF_INET6==ai->ai_family)!=(0==pass))
+                continue;
+            lsock = socket(ai->ai_family, SOCK_STREAM, 0);
+            if (lsock<0)
+                continue;
+            int opt=1;
+            setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(int));
+            opt=0;
+            if (AF_INET6==ai->ai_family)
+                setsockopt(lsock, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(int));
+            if (bind(lsock, ai->ai_addr, ai->ai_addrlen)!=0) {
+                close(lsock);
+                lsock = -1;
+            }
+        }
+    }
+    freeaddrinfo(res);
+    if (lsock<0) {
         SoapySDR_logf(SOAPY_SDR_ERROR,"binding listen socket");
         return 2;
     }
-    listen(lsock, 5);
-    freeaddrinfo(res);
-    // Wait for connections / requests on RPC sockets
-    while (true) {
-        // allocate maximum possible number of pollfds, then omit data stream connections
-        size_t nfds = s_connections.size()+1;
-        struct pollfd pfds[nfds];
-        pfds[0].fd = lsock;
-        pfds[0].events = POLLIN;
-        pfds[0].revents = 0;
-        nfds = 1;
-        for (auto it=s_connections.begin(); it!=s_connections.end(); ++it) {
-            if (it->second.rpc || it->second.log) {  // RPC or LOG connection
-                pfds[nfds].fd = it->first;
-                pfds[nfds].events = POLLIN;
-                pfds[nfds].revents = 0;
-                ++nfds;
-            }
-        }
-        if (poll(pfds, nfds, -1)<=0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR,"waiting for input");
-            return 3;
-        }
-        // Handle listen socket events
-        if (pfds[0].revents && handleListen(pfds)<0)
-            break;
-        // Handle RPC or LOG socket events
-        for (size_t idx=1; idx<nfds; ++idx) {
-            if (pfds[idx].revents) {
-                ConnectionInfo &ci = s_connections.at(pfds[idx].fd);
-                if (ci.rpc) {
-                    if (handleRPC(pfds+idx, ci)<0)
-                        return 4;
-                }
-                if (ci.log) {
-                    // any input or error on log stream means we're done
-                    fclose(ci.log);
-                    s_connections.erase(pfds[idx].fd);
-                    SoapySDR_logf(SOAPY_SDR_INFO, "log stream closed: %d", pfds[idx].fd);
-                }
-            }
+    listen(lsock, SOMAXCONN);
+    // session channels are handed to us over a pipe
+    if (pipe(s_sessionPipe)<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"creating session pipe");
+        return 2;
+    }
+    // the device cache, & devices to open now (clients connecting meanwhile wait to be accepted)
+    std::thread(cacheThread).detach();
+    for (auto &args: preload)
+        preloadDevice(args);
+    // Wait for connections / requests on RPC sockets, new session channels are handled as if just accepted
+    s_reactor.add(lsock, [lsock](uint32_t events) {
+        if (events & (EPOLLERR|EPOLLHUP)) {
+            SoapySDR_log(SOAPY_SDR_ERROR,"EOF or error in listen socket");
+            s_reactor.stop();
+            return;
         }
+        handleListen(lsock);
+    });
+    s_reactor.add(s_sessionPipe[0], [lsock](uint32_t) { handleListen(lsock); });
+    rv = s_reactor.run();
+    if (rv<0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR,"waiting for input");
+        return 3;
     }
+    if (rv>0)
+        return rv;
     s_connections.clear();
     close(lsock);
     return 0;